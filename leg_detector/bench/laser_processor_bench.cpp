@@ -0,0 +1,193 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+// Microbenchmarks of the laser_processor segmentation and of the leg features, on synthetic
+// scans of 541 to 2161 beams with 0 to 40 people. Results can be saved for comparison with
+//   leg_detector_bench --benchmark_out=results.json --benchmark_out_format=json
+
+#include "synthetic_scan.h"
+
+#include <leg_detector/laser_processor.h>
+#include <leg_detector/calc_leg_features.h>
+
+#include <benchmark/benchmark.h>
+
+using namespace std;
+using namespace laser_processor;
+using namespace leg_detector;
+
+// Scan time at which the scans are generated, the people are mid-stride
+static const double SCAN_TIME = 10.0;
+
+static void scanSizes(benchmark::internal::Benchmark* b)
+{
+  const int beams[] = {541, 1081, 2161};
+  const int people[] = {0, 5, 20, 40};
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 4; j++)
+      b->Args({beams[i], people[j]});
+  b->ArgNames({"beams", "people"});
+}
+
+static sensor_msgs::LaserScan::Ptr makeScan(const benchmark::State& state)
+{
+  SyntheticScan generator(state.range(0), state.range(1));
+  return generator.generate(SCAN_TIME);
+}
+
+static void BM_SampleExtract(benchmark::State& state)
+{
+  sensor_msgs::LaserScan::Ptr scan = makeScan(state);
+  int n = scan->ranges.size();
+
+  while (state.KeepRunning())
+  {
+    for (int i = 0; i < n; i++)
+    {
+      Sample* s = Sample::Extract(i, *scan);
+      benchmark::DoNotOptimize(s);
+      delete s;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_SampleExtract)->Apply(scanSizes);
+
+static void BM_ScanMaskHasSample(benchmark::State& state)
+{
+  SyntheticScan generator(state.range(0), state.range(1));
+  ScanMask mask;
+  mask.addScan(*generator.generate(0.0, false));
+
+  sensor_msgs::LaserScan::Ptr scan = generator.generate(SCAN_TIME);
+  SampleSet samples;
+  for (size_t i = 0; i < scan->ranges.size(); i++)
+  {
+    Sample* s = Sample::Extract(i, *scan);
+    if (s != NULL)
+      samples.insert(s);
+  }
+
+  while (state.KeepRunning())
+  {
+    for (SampleSet::iterator i = samples.begin(); i != samples.end(); i++)
+      benchmark::DoNotOptimize(mask.hasSample(*i, 0.03));
+  }
+  state.SetItemsProcessed(state.iterations() * samples.size());
+}
+BENCHMARK(BM_ScanMaskHasSample)->Apply(scanSizes);
+
+// Construction of the ScanProcessor extracts the samples outside the mask, as in the detector
+static void BM_ScanProcessor(benchmark::State& state)
+{
+  sensor_msgs::LaserScan::ConstPtr scan = makeScan(state);
+  ScanMask mask;
+
+  while (state.KeepRunning())
+  {
+    ScanProcessor processor(scan, mask);
+    benchmark::DoNotOptimize(processor.getClusters().size());
+  }
+  state.SetItemsProcessed(state.iterations() * scan->ranges.size());
+}
+BENCHMARK(BM_ScanProcessor)->Apply(scanSizes);
+
+static void BM_SplitConnected(benchmark::State& state)
+{
+  sensor_msgs::LaserScan::ConstPtr scan = makeScan(state);
+  ScanMask mask;
+
+  while (state.KeepRunning())
+  {
+    state.PauseTiming();
+    ScanProcessor* processor = new ScanProcessor(scan, mask);
+    state.ResumeTiming();
+
+    processor->splitConnected(0.06);
+
+    state.PauseTiming();
+    delete processor;
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * scan->ranges.size());
+}
+BENCHMARK(BM_SplitConnected)->Apply(scanSizes);
+
+static void BM_RemoveLessThan(benchmark::State& state)
+{
+  sensor_msgs::LaserScan::ConstPtr scan = makeScan(state);
+  ScanMask mask;
+  size_t clusters = 0;
+
+  while (state.KeepRunning())
+  {
+    state.PauseTiming();
+    ScanProcessor* processor = new ScanProcessor(scan, mask);
+    processor->splitConnected(0.06);
+    clusters = processor->getClusters().size();
+    state.ResumeTiming();
+
+    processor->removeLessThan(5);
+
+    state.PauseTiming();
+    delete processor;
+    state.ResumeTiming();
+  }
+  state.counters["clusters"] = clusters;
+}
+BENCHMARK(BM_RemoveLessThan)->Apply(scanSizes);
+
+static void BM_CalcLegFeatures(benchmark::State& state)
+{
+  sensor_msgs::LaserScan::ConstPtr scan = makeScan(state);
+  ScanMask mask;
+  ScanProcessor processor(scan, mask);
+  processor.splitConnected(0.06);
+  processor.removeLessThan(5);
+  list<SampleSet*>& clusters = processor.getClusters();
+
+  while (state.KeepRunning())
+  {
+    for (list<SampleSet*>::iterator i = clusters.begin(); i != clusters.end(); i++)
+    {
+      vector<float> features = calcLegFeatures(*i, *scan);
+      benchmark::DoNotOptimize(features.data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * clusters.size());
+  state.counters["clusters"] = clusters.size();
+}
+BENCHMARK(BM_CalcLegFeatures)->Apply(scanSizes);
+
+BENCHMARK_MAIN();
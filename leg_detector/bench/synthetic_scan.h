@@ -0,0 +1,164 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef SYNTHETICSCAN_HH
+#define SYNTHETICSCAN_HH
+
+#include "sensor_msgs/LaserScan.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+namespace leg_detector
+{
+//! Deterministic generator of planar scans of a room with walls, pillars and walking people,
+//! for benchmarking the scan processing independently of recorded data.
+class SyntheticScan
+{
+public:
+  //! A room of 15 x 10 m seen from (3, 5) by a 270 degree scanner with the given number of beams.
+  SyntheticScan(int beams, int people, uint32_t seed = 1)
+    : beams_(beams), state_(seed)
+  {
+    pillars_.push_back(Circle(4.0, 3.0, 0.25));
+    pillars_.push_back(Circle(4.0, -3.0, 0.25));
+    pillars_.push_back(Circle(8.0, 3.0, 0.25));
+    pillars_.push_back(Circle(8.0, -3.0, 0.25));
+
+    for (int i = 0; i < people; i++)
+    {
+      Walker w;
+      w.x       = 1.0 + 9.0 * uniform();
+      w.y       = -4.0 + 8.0 * uniform();
+      w.heading = 2 * M_PI * uniform();
+      w.phase   = 2 * M_PI * uniform();
+      walkers_.push_back(w);
+    }
+  }
+
+  //! The scan at time t in seconds, people walk back and forth along their heading.
+  //! Without people the scan is the static background, suitable for a ScanMask.
+  sensor_msgs::LaserScan::Ptr generate(double t, bool with_people = true)
+  {
+    std::vector<Circle> objects(pillars_);
+    if (with_people)
+    {
+      for (size_t i = 0; i < walkers_.size(); i++)
+      {
+        const Walker& w = walkers_[i];
+        double c = cos(w.heading), s = sin(w.heading);
+        double walk = 1.5 * sin(0.3 * t + w.phase);
+        double stride = 0.15 * sin(2 * M_PI * t + w.phase);
+        double x = w.x + walk * c, y = w.y + walk * s;
+
+        objects.push_back(Circle(x + stride * c - 0.1 * s, y + stride * s + 0.1 * c, 0.06));
+        objects.push_back(Circle(x - stride * c + 0.1 * s, y - stride * s - 0.1 * c, 0.06));
+      }
+    }
+
+    sensor_msgs::LaserScan::Ptr scan(new sensor_msgs::LaserScan);
+    scan->header.frame_id = "laser";
+    scan->header.stamp.fromSec(t);
+    scan->angle_min = -0.75 * M_PI;
+    scan->angle_max = 0.75 * M_PI;
+    scan->angle_increment = (scan->angle_max - scan->angle_min) / (beams_ - 1);
+    scan->range_min = 0.02;
+    scan->range_max = 30.0;
+    scan->ranges.resize(beams_);
+
+    for (int i = 0; i < beams_; i++)
+    {
+      double angle = scan->angle_min + i * scan->angle_increment;
+      double dx = cos(angle), dy = sin(angle);
+
+      // Walls of the room, which contains the sensor
+      double r = 1e9;
+      if (dx > 0) r = std::min(r, 12.0 / dx);
+      if (dx < 0) r = std::min(r, -3.0 / dx);
+      if (dy > 0) r = std::min(r, 5.0 / dy);
+      if (dy < 0) r = std::min(r, -5.0 / dy);
+
+      for (size_t j = 0; j < objects.size(); j++)
+      {
+        const Circle& o = objects[j];
+        double b = dx * o.x + dy * o.y;
+        double disc = b * b - (o.x * o.x + o.y * o.y - o.r * o.r);
+        if (disc >= 0)
+        {
+          double hit = b - sqrt(disc);
+          if (hit > 0 && hit < r)
+            r = hit;
+        }
+      }
+
+      scan->ranges[i] = r + 0.01 * gaussian();
+    }
+    return scan;
+  }
+
+private:
+  struct Circle
+  {
+    double x, y, r;
+    Circle(double x_, double y_, double r_) : x(x_), y(y_), r(r_) {}
+  };
+
+  struct Walker
+  {
+    double x, y, heading, phase;
+  };
+
+  int beams_;
+  uint32_t state_;
+  std::vector<Circle> pillars_;
+  std::vector<Walker> walkers_;
+
+  // Linear congruential generator, so that scans are identical on every platform
+  double uniform()
+  {
+    state_ = state_ * 1664525u + 1013904223u;
+    return (state_ >> 8) / 16777216.0;
+  }
+
+  double gaussian()
+  {
+    double u = uniform() + 1e-12, v = uniform();
+    return sqrt(-2.0 * log(u)) * cos(2 * M_PI * v);
+  }
+};
+};
+
+#endif
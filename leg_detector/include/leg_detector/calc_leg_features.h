@@ -38,6 +38,9 @@
 #include "laser_processor.h"
 #include "sensor_msgs/LaserScan.h"
 
+//! Length of the feature vector computed by calcLegFeatures, which a trained forest must match.
+const int LEG_FEATURE_COUNT = 14;
+
 // TODO: Should remove scan dependency from here.
 // Only used for jump distance
 std::vector<float> calcLegFeatures(laser_processor::SampleSet* cluster, const sensor_msgs::LaserScan& scan);
@@ -0,0 +1,88 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef CLOUDRINGS_HH
+#define CLOUDRINGS_HH
+
+#include <sensor_msgs/LaserScan.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <tf/LinearMath/Transform.h>
+
+#include <string>
+#include <vector>
+
+namespace leg_detector
+{
+//! Splits the cloud of a multi-ring lidar into one virtual planar scan per ring, so that each
+//! ring is segmented and featurized like a LaserScan. The points need float x, y and z fields
+//! and an integer ring field, as published by the usual Velodyne and Ouster drivers.
+class CloudRings
+{
+public:
+  //! beams is the number of azimuth bins of a virtual scan over a full turn.
+  explicit CloudRings(int beams = 1024);
+
+  //! Bins the points of every ring by azimuth, keeping the horizontally nearest point of each bin.
+  //! Returns false and sets error if the cloud lacks the needed fields.
+  bool split(const sensor_msgs::PointCloud2& cloud, std::string& error);
+
+  //! One more than the highest ring index seen so far.
+  size_t size() const
+  {
+    return scans_.size();
+  }
+
+  //! The virtual scan of a ring in the frame of the cloud, empty bins have an infinite range.
+  //! It is overwritten by the next split().
+  sensor_msgs::LaserScan::ConstPtr scan(size_t ring) const
+  {
+    return scans_[ring];
+  }
+
+  //! Median height of the binned points of a ring after applying pose, NaN without points.
+  //! Used to pick the rings at leg height.
+  double height(size_t ring, const tf::Transform& pose) const;
+
+private:
+  int beams_;
+  std::vector<sensor_msgs::LaserScan::Ptr> scans_;
+  std::vector<std::vector<tf::Vector3> > points_;
+  mutable std::vector<double> heights_;
+
+  void addRing();
+};
+};
+
+#endif
@@ -106,9 +106,10 @@ public:
 };
 
 //! A mask for filtering out Samples based on range
+//! The background is kept as the closest valid range of every beam, negative where there is none.
 class ScanMask
 {
-  SampleSet mask_;
+  std::vector<float> ranges_;
 
   bool     filled;
   float    angle_min;
@@ -121,13 +122,39 @@ public:
 
   inline void clear()
   {
-    mask_.clear();
+    ranges_.clear();
     filled = false;
   }
 
-  void addScan(sensor_msgs::LaserScan& scan);
+  inline bool empty() const
+  {
+    return !filled;
+  }
+
+  //! Whether the mask was built for scans with the geometry of this one.
+  inline bool matches(const sensor_msgs::LaserScan& scan) const
+  {
+    return filled && angle_min == scan.angle_min && angle_max == scan.angle_max && size == scan.ranges.size();
+  }
+
+  void addScan(const sensor_msgs::LaserScan& scan);
+
+  inline bool hasSample(Sample* s, float thresh) const
+  {
+    if (s != NULL && (uint32_t)s->index < ranges_.size())
+    {
+      float r = ranges_[s->index];
+      if (r >= 0 && (r - thresh) < s->range)
+        return true;
+    }
+    return false;
+  }
 
-  bool hasSample(Sample* s, float thresh);
+  //! Writes the mask and its scan geometry to a compact binary file.
+  bool save(const std::string& file) const;
+
+  //! Replaces the mask with one saved by save(), returns false and leaves it empty on failure.
+  bool load(const std::string& file);
 };
 
 
@@ -135,7 +162,10 @@ public:
 class ScanProcessor
 {
   std::list<SampleSet*> clusters_;
-  sensor_msgs::LaserScan scan_;
+  sensor_msgs::LaserScan::ConstPtr scan_;
+  unsigned int allocations_;
+
+  void extractSamples(ScanMask& mask_, float mask_threshold, const std::vector<bool>* beams);
 
 public:
 
@@ -144,7 +174,25 @@ public:
     return clusters_;
   }
 
-  ScanProcessor(const sensor_msgs::LaserScan& scan, ScanMask& mask_, float mask_threshold = 0.03);
+  const sensor_msgs::LaserScan& getScan() const
+  {
+    return *scan_;
+  }
+
+  //! Heap allocations made so far: Samples, SampleSets, and the nodes of the sets and lists.
+  unsigned int getAllocations() const
+  {
+    return allocations_;
+  }
+
+  //! Shares the scan with the caller, no copy of the ranges is made.
+  //! If beams is given, only the beams whose entry is true are extracted.
+  ScanProcessor(const sensor_msgs::LaserScan::ConstPtr& scan, ScanMask& mask_, float mask_threshold = 0.03,
+                const std::vector<bool>* beams = NULL);
+
+  //! Takes a private copy of the scan, prefer the ConstPtr version when the message is already shared.
+  ScanProcessor(const sensor_msgs::LaserScan& scan, ScanMask& mask_, float mask_threshold = 0.03,
+                const std::vector<bool>* beams = NULL);
 
   ~ScanProcessor();
 
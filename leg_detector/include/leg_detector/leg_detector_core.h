@@ -0,0 +1,371 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef LEGDETECTORCORE_HH
+#define LEGDETECTORCORE_HH
+
+#include "laser_processor.h"
+#include "scan_profiler.h"
+
+#include <tf/LinearMath/Transform.h>
+
+#include <boost/atomic.hpp>
+
+#include <cstdio>
+#include <list>
+#include <string>
+#include <vector>
+
+class CvRTrees;
+struct CvMat;
+
+namespace leg_detector
+{
+class SavedFeature;
+
+//! Tuning parameters of the detector, see cfg/LegDetector.cfg for their meaning.
+struct LegDetectorParams
+{
+  float  connected_thresh;
+  int    min_points_per_group;
+  double leg_reliability_limit;
+  double no_observation_timeout;
+  double max_second_leg_age;
+  double max_track_jump;
+  double max_meas_jump;
+  double leg_pair_separation;
+  double kal_p, kal_q, kal_r;
+  bool   use_filter;
+  bool   use_seeds;
+  int    roi_full_scan_interval;
+  double roi_change_threshold;
+  int    reuse_max_scans;
+  double reuse_min_reliability;
+  double reuse_feature_drift;
+  int    max_tracks;
+  double birth_probability;
+  double scan_deadline;
+  double fusion_distance;
+
+  LegDetectorParams()
+    : connected_thresh(0.06), min_points_per_group(5), leg_reliability_limit(0.7),
+      no_observation_timeout(0.5), max_second_leg_age(2.0), max_track_jump(1.0),
+      max_meas_jump(0.75), leg_pair_separation(1.0),
+      kal_p(4), kal_q(.002), kal_r(10), use_filter(true), use_seeds(false),
+      roi_full_scan_interval(1), roi_change_threshold(0.1),
+      reuse_max_scans(0), reuse_min_reliability(0.9), reuse_feature_drift(0.1),
+      max_tracks(0), birth_probability(0.0), scan_deadline(0.0),
+      fusion_distance(0.1)
+  {}
+};
+
+//! Geometry of a planar scan, with the same meaning as in sensor_msgs::LaserScan.
+struct ScanGeometry
+{
+  float angle_min;
+  float angle_max;
+  float angle_increment;
+  float range_min;
+  float range_max;
+};
+
+//! A tracked leg, in the fixed frame.
+struct Leg
+{
+  int         track_id;
+  std::string id;
+  std::string object_id;
+  tf::Vector3 position;
+  tf::Vector3 velocity;
+  double      reliability;
+  double      stamp;
+};
+
+//! A pair of tracked legs, in the fixed frame.
+struct Person
+{
+  int         track_id;
+  std::string name;
+  std::string object_id;
+  tf::Vector3 position;
+  tf::Vector3 velocity;
+  double      reliability;
+  double      stamp;
+};
+
+//! The steps skipped to meet the scan deadline, or'ed in LegDetectorResult::degraded.
+enum DegradeStep
+{
+  DEGRADE_FAR_CLUSTERS = 1,  // the clusters farthest from the sensor were not processed
+  DEGRADE_PAIRING      = 2,  // legs were not re-paired, people keep their previous pairs
+  DEGRADE_MARKERS      = 4   // visualization was not published, set by the caller
+};
+
+struct LegDetectorResult
+{
+  std::vector<Leg>    legs;
+  std::vector<Person> people;
+
+  double       stamp;             // of the newest scan that went into the result
+  double       deadline;          // monotonicNow() by which the scan should be done, 0 if none
+  unsigned int degraded;          // DegradeStep flags
+  unsigned int skipped_clusters;
+
+  LegDetectorResult() : stamp(0.0), deadline(0.0), degraded(0), skipped_clusters(0) {}
+};
+
+//! A featurized cluster, located in the fixed frame.
+struct LegCandidate
+{
+  tf::Vector3        position;
+  float              range;       // from the sensor that saw it
+  unsigned int       points;
+  std::vector<float> features;
+};
+
+//! The candidates of one scan, see LegDetectorCore::extractCandidates().
+struct CandidateBatch
+{
+  int          channel;           // the scanner, batches of different channels are fused
+  double       stamp;
+  double       deadline;
+  std::vector<LegCandidate> candidates;
+  unsigned int degraded;          // DegradeStep flags
+  unsigned int skipped_clusters;
+  ScanProfile  profile;           // segmentation and featurization
+
+  CandidateBatch() : channel(0), stamp(0.0), deadline(0.0), degraded(0), skipped_clusters(0) {}
+};
+
+//! The per-scanner state of candidate extraction: the background mask and the region of interest.
+struct ScanChannel
+{
+  laser_processor::ScanMask mask;
+  int scans_since_full;
+  std::vector<float> prev_ranges;
+  std::vector<bool> roi;
+  std::vector<int> roi_edges;
+
+  ScanChannel() : scans_since_full(0) {}
+};
+
+//! The leg detection and tracking pipeline, independent of any node, callback or tf listener.
+//! Scans are segmented, classified with a random forest and tracked in a fixed frame, whose
+//! relation to the sensor is supplied by the caller. Not thread safe.
+//!
+//! With roi_full_scan_interval N > 1 only every Nth scan is processed entirely. The scans in
+//! between are restricted to the sectors within max_track_jump of a predicted track and of
+//! the beams whose range changed by more than roi_change_threshold since the previous scan.
+//!
+//! With reuse_max_scans K > 0, a cluster matched to a track of at least reuse_min_reliability
+//! reuses the track's last classifier probability for up to K scans, as long as its features
+//! stay within a relative distance of reuse_feature_drift of the classified ones.
+//!
+//! Unmatched clusters start new tracks only with a probability of at least birth_probability,
+//! and, with max_tracks > 0, only while the budget allows or a less reliable track can be evicted.
+//!
+//! With scan_deadline > 0 a scan degrades when its processing time is about to exceed the
+//! deadline: clusters are processed nearest first and the rest are skipped, then pairing is
+//! skipped if its last duration no longer fits. The steps taken are reported in the result.
+//!
+//! Several scanners share one track set: each runs extractCandidates() on its own ScanChannel,
+//! possibly in parallel, and processBatches() tracks their candidates in a single pass. Legs seen
+//! by more than one scanner within fusion_distance are measured once, by the denser cluster.
+class LegDetectorCore
+{
+public:
+  LegDetectorCore();
+  ~LegDetectorCore();
+
+  //! Loads a trained random forest, returns false if the file could not be used.
+  bool loadModel(const std::string& file, std::string* error = NULL);
+
+  //! Reads and validates a trained random forest without touching any detector, so that it
+  //! can run on a background thread. Returns NULL and sets error if the file cannot be used.
+  static CvRTrees* readModel(const std::string& file, std::string& error);
+
+  //! Hands over a forest from readModel() to be used from the next scan on. Safe to call from
+  //! any thread while scans are processed. A model offered before and not yet used is discarded.
+  void offerModel(CvRTrees* forest);
+
+  //! Number of models swapped in by offerModel() so far.
+  unsigned long getModelSwapCount() const
+  {
+    return model_swaps_;
+  }
+
+  int getFeatureCount() const
+  {
+    return feat_count_;
+  }
+
+  void setParams(const LegDetectorParams& params)
+  {
+    params_ = params;
+  }
+
+  const LegDetectorParams& getParams() const
+  {
+    return params_;
+  }
+
+  laser_processor::ScanMask& getMask()
+  {
+    return channel_.mask;
+  }
+
+  size_t getTrackCount() const
+  {
+    return saved_features_.size();
+  }
+
+  size_t getPeakTrackCount() const
+  {
+    return peak_tracks_;
+  }
+
+  unsigned long getEvictedTrackCount() const
+  {
+    return evicted_tracks_;
+  }
+
+  unsigned long getRejectedBirthCount() const
+  {
+    return rejected_births_;
+  }
+
+  unsigned long getLateBatchCount() const
+  {
+    return late_batches_;
+  }
+
+  //! Processes one scan given as ranges plus geometry, stamped in seconds.
+  //! sensor_pose maps sensor coordinates to the fixed frame, NULL when they coincide.
+  void processScan(const std::vector<float>& ranges, const ScanGeometry& geometry,
+                   const tf::Transform* sensor_pose, double stamp, LegDetectorResult& result);
+
+  //! Same as above for a scan message, which is shared rather than copied.
+  void processScan(const sensor_msgs::LaserScan::ConstPtr& scan,
+                   const tf::Transform* sensor_pose, LegDetectorResult& result);
+
+  //! Same as above for a scan of one of several scanners, with its own channel state. Takes the
+  //! steps the node takes for every scan: extractCandidates() around the tracks of the last pass,
+  //! then processBatches() on the batch alone.
+  void processScan(const sensor_msgs::LaserScan::ConstPtr& scan, const tf::Transform* sensor_pose,
+                   int channel_index, ScanChannel& channel, LegDetectorResult& result);
+
+  //! Segments and featurizes a scan into batch, using and updating the state of its scanner in
+  //! channel. tracks are the fixed frame positions the region of interest is built around.
+  //! Touches no detector state, so scanners can be processed on threads of their own.
+  static void extractCandidates(const LegDetectorParams& params, const sensor_msgs::LaserScan::ConstPtr& scan,
+                                const tf::Transform* sensor_pose, const std::vector<tf::Vector3>& tracks,
+                                double deadline, ScanChannel& channel, CandidateBatch& batch);
+
+  //! Positions of the current tracks in the fixed frame, for extractCandidates().
+  void getTrackPositions(std::vector<tf::Vector3>& positions) const;
+
+  //! Tracks the candidates of scans from several scanners at the stamp of the newest one.
+  //! Only the newest batch of each channel is used.
+  void processBatches(const std::vector<CandidateBatch>& batches, LegDetectorResult& result);
+
+  //! Assigns a person label from an external people tracker to the nearest leg tracks.
+  //! The position is in the fixed frame.
+  void seedPerson(const std::string& object_id, const tf::Vector3& position);
+
+  //! The profile of the most recent scan stays open until commitProfile(), so that callers
+  //! can add the time they spend publishing the result to STAGE_PUBLISH.
+  ScanProfile& getProfile()
+  {
+    return profile_;
+  }
+
+  void commitProfile()
+  {
+    LEG_PROFILE_END(profiler_, profile_);
+  }
+
+  const ScanProfiler& getProfiler() const
+  {
+    return profiler_;
+  }
+
+private:
+  LegDetectorParams params_;
+  ScanChannel channel_;     // of the scans given to processScan() without a channel
+  std::vector<CandidateBatch> scan_batch_;
+  std::vector<tf::Vector3> scan_tracks_;
+  std::vector<const LegCandidate*> fused_;
+
+  CvRTrees* forest_;
+  CvMat* feat_mat_;
+  int feat_count_;
+
+  // Models are exchanged without locks: the loader publishes into pending_forest_, the scan
+  // thread takes it at the start of a scan and retires the previous one for the loader to free.
+  boost::atomic<CvRTrees*> pending_forest_;
+  boost::atomic<CvRTrees*> retired_forest_;
+  unsigned long model_swaps_;
+
+  std::list<SavedFeature*> saved_features_;
+  int next_p_id_;
+  size_t peak_tracks_;
+  double pair_time_;
+  unsigned long evicted_tracks_;
+  unsigned long rejected_births_;
+  // stamp of the last pass over batches, and the batches that were older
+  double batch_stamp_;
+  unsigned long late_batches_;
+
+  ScanProfile profile_;
+  ScanProfiler profiler_;
+
+  void useModel(CvRTrees* forest);
+  bool prepare(double stamp, double deadline, LegDetectorResult& result);
+  void update(std::vector<const LegCandidate*>& candidates, double stamp, LegDetectorResult& result);
+  double classify(const std::vector<float>& features);
+  bool evictTrack(double priority, size_t existing);
+  void pairLegs();
+  void fillResult(LegDetectorResult& result) const;
+
+  // not copyable
+  LegDetectorCore(const LegDetectorCore&);
+  LegDetectorCore& operator=(const LegDetectorCore&);
+};
+
+//! Writes a result as one line for the pass, followed by one line per leg and per person. The
+//! node and leg_detector_replay share this format, so that their detections can be compared.
+void writeDetections(FILE* out, const LegDetectorResult& result);
+};
+
+#endif
@@ -0,0 +1,98 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef ROLLINGPERCENTILES_HH
+#define ROLLINGPERCENTILES_HH
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+namespace leg_detector
+{
+//! A fixed-size window over the most recent values, from which percentiles are computed on demand.
+//! Adding a value never allocates, so it is safe to use on the scan processing path.
+class RollingPercentiles
+{
+public:
+  RollingPercentiles(size_t capacity = 256)
+    : values_(capacity > 0 ? capacity : 1), next_(0), count_(0)
+  {}
+
+  inline void add(double value)
+  {
+    values_[next_] = value;
+    next_ = (next_ + 1) % values_.size();
+    if (count_ < values_.size())
+      count_++;
+  }
+
+  inline void clear()
+  {
+    next_ = 0;
+    count_ = 0;
+  }
+
+  inline size_t size() const
+  {
+    return count_;
+  }
+
+  //! Returns the q-th quantile (0 <= q <= 1) of the values in the window, or 0 if it is empty.
+  double percentile(double q) const
+  {
+    if (count_ == 0)
+      return 0.0;
+
+    std::vector<double> sorted(values_.begin(), values_.begin() + count_);
+    size_t k = (size_t)(std::max(0.0, std::min(1.0, q)) * (count_ - 1) + 0.5);
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    return sorted[k];
+  }
+
+  double max() const
+  {
+    if (count_ == 0)
+      return 0.0;
+    return *std::max_element(values_.begin(), values_.begin() + count_);
+  }
+
+private:
+  std::vector<double> values_;
+  size_t next_;
+  size_t count_;
+};
+};
+
+#endif
@@ -0,0 +1,208 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef SCANPROFILER_HH
+#define SCANPROFILER_HH
+
+#include <time.h>
+#include <boost/preprocessor/cat.hpp>
+
+#include "rolling_percentiles.h"
+
+namespace leg_detector
+{
+//! The stages of the scan processing pipeline that are timed separately.
+enum ScanStage
+{
+  STAGE_SEGMENT,
+  STAGE_PREDICT,
+  STAGE_FEATURIZE,
+  STAGE_CLASSIFY,
+  STAGE_ASSOCIATE,
+  STAGE_PAIR,
+  STAGE_PUBLISH,
+  NUM_SCAN_STAGES
+};
+
+inline const char* scanStageName(int stage)
+{
+  static const char* names[NUM_SCAN_STAGES] =
+  {"segment", "predict", "featurize", "classify", "associate", "pair", "publish"};
+  return names[stage];
+}
+
+//! Seconds on a monotonic clock, unaffected by time jumps and by simulated time.
+inline double monotonicNow()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//! Counters and stage times of a single scan.
+struct ScanProfile
+{
+  double stage_time[NUM_SCAN_STAGES];
+  double start;
+  unsigned int beams;
+  unsigned int clusters;
+  unsigned int reused;
+  unsigned int tracks;
+  unsigned int allocations;     // heap allocations of segmentation, see ScanProcessor::getAllocations()
+
+  ScanProfile()
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    for (int i = 0; i < NUM_SCAN_STAGES; i++)
+      stage_time[i] = 0.0;
+    start = monotonicNow();
+    beams = 0;
+    clusters = 0;
+    reused = 0;
+    tracks = 0;
+    allocations = 0;
+  }
+
+  //! Adds the stage times and counters of a part of the scan profiled separately.
+  void merge(const ScanProfile& part)
+  {
+    for (int i = 0; i < NUM_SCAN_STAGES; i++)
+      stage_time[i] += part.stage_time[i];
+    beams += part.beams;
+    clusters += part.clusters;
+    reused += part.reused;
+    allocations += part.allocations;
+  }
+};
+
+//! Adds the time spent in its scope, or until stop() is called, to one stage of a ScanProfile.
+class ScopedStageTimer
+{
+public:
+  ScopedStageTimer(ScanProfile& profile, ScanStage stage)
+    : profile_(profile), stage_(stage), start_(monotonicNow()), running_(true)
+  {}
+
+  ~ScopedStageTimer()
+  {
+    stop();
+  }
+
+  inline void stop()
+  {
+    if (running_)
+    {
+      profile_.stage_time[stage_] += monotonicNow() - start_;
+      running_ = false;
+    }
+  }
+
+  //! Resumes a stopped timer, leaving out the time since stop().
+  inline void restart()
+  {
+    if (!running_)
+    {
+      start_ = monotonicNow();
+      running_ = true;
+    }
+  }
+
+private:
+  ScanProfile& profile_;
+  ScanStage stage_;
+  double start_;
+  bool running_;
+};
+
+//! Rolling distributions of the per-scan profiles.
+class ScanProfiler
+{
+public:
+  RollingPercentiles stage_time[NUM_SCAN_STAGES];
+  RollingPercentiles total_time;
+  RollingPercentiles beams;
+  RollingPercentiles clusters;
+  RollingPercentiles reused;
+  RollingPercentiles tracks;
+  RollingPercentiles allocations;
+  unsigned long scans;
+
+  ScanProfiler() : scans(0) {}
+
+  void add(const ScanProfile& profile)
+  {
+    for (int i = 0; i < NUM_SCAN_STAGES; i++)
+      stage_time[i].add(profile.stage_time[i]);
+    total_time.add(monotonicNow() - profile.start);
+    beams.add(profile.beams);
+    clusters.add(profile.clusters);
+    reused.add(profile.reused);
+    tracks.add(profile.tracks);
+    allocations.add(profile.allocations);
+    scans++;
+  }
+};
+};
+
+// Instrumentation macros, defining LEG_DETECTOR_PROFILING=0 compiles them out entirely.
+#ifndef LEG_DETECTOR_PROFILING
+#define LEG_DETECTOR_PROFILING 1
+#endif
+
+#if LEG_DETECTOR_PROFILING
+#define LEG_PROFILE_STAGE(profile, stage) \
+  leg_detector::ScopedStageTimer BOOST_PP_CAT(stage_timer_, __LINE__)(profile, leg_detector::stage)
+#define LEG_PROFILE_START(profile, stage, timer) leg_detector::ScopedStageTimer timer(profile, leg_detector::stage)
+#define LEG_PROFILE_STOP(timer) timer.stop()
+#define LEG_PROFILE_RESTART(timer) timer.restart()
+#define LEG_PROFILE_COUNT(profile, counter, n) ((profile).counter += (n))
+#define LEG_PROFILE_BEGIN(profile) (profile).reset()
+#define LEG_PROFILE_END(profiler, profile) (profiler).add(profile)
+#define LEG_PROFILE_MERGE(profile, part) (profile).merge(part)
+#else
+#define LEG_PROFILE_STAGE(profile, stage)
+#define LEG_PROFILE_START(profile, stage, timer)
+#define LEG_PROFILE_STOP(timer)
+#define LEG_PROFILE_RESTART(timer)
+#define LEG_PROFILE_COUNT(profile, counter, n)
+#define LEG_PROFILE_BEGIN(profile)
+#define LEG_PROFILE_END(profiler, profile)
+#define LEG_PROFILE_MERGE(profile, part)
+#endif
+
+#endif
@@ -0,0 +1,45 @@
+#!/bin/bash
+# Checks that leg_detector_replay detects what the node detects on the same bag.
+#
+# Usage: compare_replay.sh <model_file> <bag> [scan_topic]
+#
+# Plays the bag in simulated time into a node that writes every tracking pass to a file, runs
+# the replay on the same bag, and compares the two. Both must use the default parameters, and
+# the node must keep up with the bag, so that it tracks every scan on its own.
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 <model_file> <bag> [scan_topic]" >&2
+  exit 1
+fi
+
+model=$1
+bag=$2
+topic=${3:-scan}
+dir=$(mktemp -d)
+trap 'kill $node $core 2> /dev/null; wait; rm -rf "$dir"' EXIT
+
+export ROS_MASTER_URI=http://localhost:11399
+roscore -p 11399 > "$dir/roscore.log" 2>&1 &
+core=$!
+sleep 3
+rosparam set use_sim_time true
+
+rosrun leg_detector leg_detector "$model" _scan_topics:="[$topic]" \
+  _detections_file:="$dir/node.txt" > "$dir/node.log" 2>&1 &
+node=$!
+sleep 3
+
+rosbag play --clock -q "$bag" || exit 1
+sleep 2
+kill -INT $node
+wait $node
+
+rosrun leg_detector leg_detector_replay "$model" "$bag" -s "/${topic#/}" -o "$dir/replay.txt" > /dev/null || exit 1
+
+if diff "$dir/node.txt" "$dir/replay.txt" > "$dir/diff.txt"; then
+  echo "The node and the replay agree on $(grep -c '^scan' "$dir/node.txt") passes"
+else
+  echo "The node and the replay differ:"
+  head -40 "$dir/diff.txt"
+  exit 1
+fi
@@ -0,0 +1,235 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <leg_detector/cloud_rings.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace std;
+
+namespace leg_detector
+{
+// Ring indices above this are taken for corrupt data rather than grown into
+static const int MAX_RINGS = 256;
+
+static const sensor_msgs::PointField* findField(const sensor_msgs::PointCloud2& cloud, const char* name)
+{
+  for (size_t i = 0; i < cloud.fields.size(); i++)
+    if (cloud.fields[i].name == name)
+      return &cloud.fields[i];
+  return NULL;
+}
+
+// Size in bytes of a field of the types readInt() supports, 0 for the others.
+static size_t fieldSize(uint8_t datatype)
+{
+  switch (datatype)
+  {
+  case sensor_msgs::PointField::INT8:
+  case sensor_msgs::PointField::UINT8:
+    return 1;
+  case sensor_msgs::PointField::INT16:
+  case sensor_msgs::PointField::UINT16:
+    return 2;
+  case sensor_msgs::PointField::INT32:
+  case sensor_msgs::PointField::UINT32:
+  case sensor_msgs::PointField::FLOAT32:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+// Whether a field lies within a point
+static bool fieldFits(const sensor_msgs::PointField& field, uint32_t point_step)
+{
+  return (uint64_t)field.offset + fieldSize(field.datatype) <= point_step;
+}
+
+// Reads an integer valued field of any of the types drivers use for the ring, -1 if unsupported.
+static int readInt(const uint8_t* data, uint8_t datatype)
+{
+  switch (datatype)
+  {
+  case sensor_msgs::PointField::INT8:
+    return *reinterpret_cast<const int8_t*>(data);
+  case sensor_msgs::PointField::UINT8:
+    return *data;
+  case sensor_msgs::PointField::INT16:
+  {
+    int16_t v;
+    memcpy(&v, data, sizeof(v));
+    return v;
+  }
+  case sensor_msgs::PointField::UINT16:
+  {
+    uint16_t v;
+    memcpy(&v, data, sizeof(v));
+    return v;
+  }
+  case sensor_msgs::PointField::INT32:
+  case sensor_msgs::PointField::UINT32:
+  {
+    int32_t v;
+    memcpy(&v, data, sizeof(v));
+    return v;
+  }
+  case sensor_msgs::PointField::FLOAT32:
+  {
+    float v;
+    memcpy(&v, data, sizeof(v));
+    return (int)v;
+  }
+  default:
+    return -1;
+  }
+}
+
+CloudRings::CloudRings(int beams) : beams_(std::max(beams, 1))
+{
+}
+
+void CloudRings::addRing()
+{
+  sensor_msgs::LaserScan::Ptr scan(new sensor_msgs::LaserScan);
+  scan->angle_increment = 2 * M_PI / beams_;
+  scan->angle_min = -M_PI;
+  scan->angle_max = scan->angle_min + (beams_ - 1) * scan->angle_increment;
+  scan->range_min = 0.0;
+  scan->range_max = numeric_limits<float>::max();
+  scan->ranges.assign(beams_, numeric_limits<float>::infinity());
+  scans_.push_back(scan);
+  points_.push_back(vector<tf::Vector3>(beams_));
+}
+
+bool CloudRings::split(const sensor_msgs::PointCloud2& cloud, std::string& error)
+{
+  const sensor_msgs::PointField* x = findField(cloud, "x");
+  const sensor_msgs::PointField* y = findField(cloud, "y");
+  const sensor_msgs::PointField* z = findField(cloud, "z");
+  const sensor_msgs::PointField* ring = findField(cloud, "ring");
+  if (x == NULL || y == NULL || z == NULL || ring == NULL)
+  {
+    error = "the cloud has no x, y, z or ring field";
+    return false;
+  }
+  if (x->datatype != sensor_msgs::PointField::FLOAT32 || y->datatype != sensor_msgs::PointField::FLOAT32
+      || z->datatype != sensor_msgs::PointField::FLOAT32)
+  {
+    error = "the x, y and z fields of the cloud are not float32";
+    return false;
+  }
+  if (fieldSize(ring->datatype) == 0)
+  {
+    error = "the ring field of the cloud is not an integer or float32";
+    return false;
+  }
+  if (!fieldFits(*x, cloud.point_step) || !fieldFits(*y, cloud.point_step) || !fieldFits(*z, cloud.point_step)
+      || !fieldFits(*ring, cloud.point_step))
+  {
+    error = "the x, y, z or ring field of the cloud exceeds its point step";
+    return false;
+  }
+  if ((uint64_t)cloud.width * cloud.point_step > cloud.row_step)
+  {
+    error = "the points of a row of the cloud exceed its row step";
+    return false;
+  }
+  if (cloud.data.size() < (uint64_t)cloud.row_step * cloud.height)
+  {
+    error = "the cloud is truncated";
+    return false;
+  }
+
+  for (size_t r = 0; r < scans_.size(); r++)
+    scans_[r]->ranges.assign(beams_, numeric_limits<float>::infinity());
+
+  // a cloud without points may come without data too
+  const uint32_t height = cloud.width > 0 ? cloud.height : 0;
+  const float bins_per_radian = beams_ / (2 * M_PI);
+  for (uint32_t row = 0; row < height; row++)
+  {
+    const uint8_t* point = &cloud.data[0] + row * cloud.row_step;
+    for (uint32_t col = 0; col < cloud.width; col++, point += cloud.point_step)
+    {
+      float px, py, pz;
+      memcpy(&px, point + x->offset, sizeof(float));
+      memcpy(&py, point + y->offset, sizeof(float));
+      memcpy(&pz, point + z->offset, sizeof(float));
+      int r = readInt(point + ring->offset, ring->datatype);
+      if (r < 0 || r >= MAX_RINGS || !isfinite(px) || !isfinite(py) || !isfinite(pz))
+        continue;
+
+      while ((int)scans_.size() <= r)
+        addRing();
+
+      float range = hypot(px, py);
+      int bin = std::min((int)((atan2(py, px) + M_PI) * bins_per_radian), beams_ - 1);
+      float& nearest = scans_[r]->ranges[bin];
+      if (range < nearest)
+      {
+        nearest = range;
+        points_[r][bin] = tf::Vector3(px, py, pz);
+      }
+    }
+  }
+
+  for (size_t r = 0; r < scans_.size(); r++)
+  {
+    scans_[r]->header = cloud.header;
+    scans_[r]->scan_time = 0.0;
+    scans_[r]->time_increment = 0.0;
+  }
+  return true;
+}
+
+double CloudRings::height(size_t ring, const tf::Transform& pose) const
+{
+  heights_.clear();
+  const vector<float>& ranges = scans_[ring]->ranges;
+  for (int b = 0; b < beams_; b++)
+    if (isfinite(ranges[b]))
+      heights_.push_back(pose(points_[ring][b]).z());
+
+  if (heights_.empty())
+    return numeric_limits<double>::quiet_NaN();
+
+  vector<double>::iterator median = heights_.begin() + heights_.size() / 2;
+  nth_element(heights_.begin(), median, heights_.end());
+  return *median;
+}
+};
@@ -34,6 +34,7 @@
 
 #include <leg_detector/laser_processor.h>
 
+#include <fstream>
 #include <stdexcept>
 
 using namespace ros;
@@ -108,7 +109,7 @@ tf::Point SampleSet::center()
 }
 
 
-void ScanMask::addScan(sensor_msgs::LaserScan& scan)
+void ScanMask::addScan(const sensor_msgs::LaserScan& scan)
 {
   if (!filled)
   {
@@ -116,6 +117,7 @@ void ScanMask::addScan(sensor_msgs::LaserScan& scan)
     angle_max = scan.angle_max;
     size      = scan.ranges.size();
     filled    = true;
+    ranges_.assign(size, -1.0f);
   }
   else if (angle_min != scan.angle_min     ||
            angle_max != scan.angle_max     ||
@@ -126,63 +128,100 @@ void ScanMask::addScan(sensor_msgs::LaserScan& scan)
 
   for (uint32_t i = 0; i < scan.ranges.size(); i++)
   {
-    Sample* s = Sample::Extract(i, scan);
-
-    if (s != NULL)
-    {
-      SampleSet::iterator m = mask_.find(s);
-
-      if (m != mask_.end())
-      {
-        if ((*m)->range > s->range)
-        {
-          delete(*m);
-          mask_.erase(m);
-          mask_.insert(s);
-        }
-        else
-        {
-          delete s;
-        }
-      }
-      else
-      {
-        mask_.insert(s);
-      }
-    }
+    float r = scan.ranges[i];
+    if (r > scan.range_min && r < scan.range_max
+        && (ranges_[i] < 0 || r < ranges_[i]))
+      ranges_[i] = r;
   }
 }
 
+// File layout: magic, version, angle_min, angle_max, beam count, then one float range per beam.
+static const char MASK_MAGIC[4] = {'L', 'D', 'M', 'K'};
+static const uint32_t MASK_VERSION = 1;
 
-bool ScanMask::hasSample(Sample* s, float thresh)
+bool ScanMask::save(const std::string& file) const
 {
-  if (s != NULL)
+  if (!filled)
+    return false;
+
+  std::ofstream out(file.c_str(), std::ios::binary);
+  out.write(MASK_MAGIC, sizeof(MASK_MAGIC));
+  out.write((const char*)&MASK_VERSION, sizeof(MASK_VERSION));
+  out.write((const char*)&angle_min, sizeof(angle_min));
+  out.write((const char*)&angle_max, sizeof(angle_max));
+  out.write((const char*)&size, sizeof(size));
+  out.write((const char*)&ranges_[0], size * sizeof(float));
+  return out.good();
+}
+
+bool ScanMask::load(const std::string& file)
+{
+  clear();
+
+  std::ifstream in(file.c_str(), std::ios::binary);
+  char magic[4];
+  uint32_t version = 0;
+  in.read(magic, sizeof(magic));
+  in.read((char*)&version, sizeof(version));
+  if (!in || !std::equal(magic, magic + 4, MASK_MAGIC) || version != MASK_VERSION)
+    return false;
+
+  in.read((char*)&angle_min, sizeof(angle_min));
+  in.read((char*)&angle_max, sizeof(angle_max));
+  in.read((char*)&size, sizeof(size));
+  if (!in || size == 0)
+    return false;
+
+  ranges_.resize(size);
+  in.read((char*)&ranges_[0], size * sizeof(float));
+  if (!in)
   {
-    SampleSet::iterator m = mask_.find(s);
-    if (m != mask_.end())
-      if (((*m)->range - thresh) < s->range)
-        return true;
+    ranges_.clear();
+    return false;
   }
-  return false;
+
+  filled = true;
+  return true;
 }
 
 
 
-ScanProcessor::ScanProcessor(const sensor_msgs::LaserScan& scan, ScanMask& mask_, float mask_threshold)
+ScanProcessor::ScanProcessor(const sensor_msgs::LaserScan::ConstPtr& scan, ScanMask& mask_, float mask_threshold,
+                             const std::vector<bool>* beams)
+  : scan_(scan), allocations_(0)
+{
+  extractSamples(mask_, mask_threshold, beams);
+}
+
+ScanProcessor::ScanProcessor(const sensor_msgs::LaserScan& scan, ScanMask& mask_, float mask_threshold,
+                             const std::vector<bool>* beams)
+  : scan_(new sensor_msgs::LaserScan(scan)), allocations_(0)
 {
-  scan_ = scan;
+  extractSamples(mask_, mask_threshold, beams);
+}
+
+void ScanProcessor::extractSamples(ScanMask& mask_, float mask_threshold, const std::vector<bool>* beams)
+{
+  const sensor_msgs::LaserScan& scan = *scan_;
 
   SampleSet* cluster = new SampleSet;
+  allocations_++;
 
   for (uint32_t i = 0; i < scan.ranges.size(); i++)
   {
+    if (beams != NULL && !(*beams)[i])
+      continue;
+
+    // Extract allocates the sample before it checks the range
     Sample* s = Sample::Extract(i, scan);
+    allocations_++;
 
     if (s != NULL)
     {
       if (!mask_.hasSample(s, mask_threshold))
       {
         cluster->insert(s);
+        allocations_++;
       }
       else
       {
@@ -192,6 +231,7 @@ ScanProcessor::ScanProcessor(const sensor_msgs::LaserScan& scan, ScanMask& mask_
   }
 
   clusters_.push_back(cluster);
+  allocations_++;
 
 }
 
@@ -248,7 +288,7 @@ ScanProcessor::splitConnected(float thresh)
       list<Sample*>::iterator s_q = sample_queue.begin();
       while (s_q != sample_queue.end())
       {
-        int expand = (int)(asin(thresh / (*s_q)->range) / std::abs(scan_.angle_increment));
+        int expand = (int)(asin(thresh / (*s_q)->range) / std::abs(scan_->angle_increment));
 
         SampleSet::iterator s_rest = (*c_iter)->begin();
 
@@ -280,6 +320,9 @@ ScanProcessor::splitConnected(float thresh)
 
       // Store the temporary clusters
       tmp_clusters.push_back(c);
+
+      // The queue and set nodes of every sample, the new set and its node in tmp_clusters and clusters_
+      allocations_ += 2 * sample_queue.size() + 3;
     }
 
     //Now that c_iter is empty, we can delete
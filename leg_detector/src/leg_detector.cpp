@@ -32,207 +32,138 @@
 *  POSSIBILITY OF SUCH DAMAGE.
 *********************************************************************/
 #include <ros/ros.h>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
 
 #include <leg_detector/LegDetectorConfig.h>
-#include <leg_detector/laser_processor.h>
-#include <leg_detector/calc_leg_features.h>
-
-#include <opencv/cxcore.h>
-#include <opencv/cv.h>
-#include <opencv/ml.h>
+#include <leg_detector/cloud_rings.h>
+#include <leg_detector/leg_detector_core.h>
+#include <leg_detector/rolling_percentiles.h>
+#include <leg_detector/scan_profiler.h>
 
 #include <people_msgs/PositionMeasurement.h>
 #include <people_msgs/PositionMeasurementArray.h>
+#include <people_msgs/People.h>
 #include <sensor_msgs/LaserScan.h>
+#include <sensor_msgs/PointCloud2.h>
 
 #include <tf/transform_listener.h>
 #include <tf/message_filter.h>
 #include <message_filters/subscriber.h>
 
-#include <people_tracking_filter/tracker_kalman.h>
-#include <people_tracking_filter/state_pos_vel.h>
-#include <people_tracking_filter/rgb.h>
-#include <visualization_msgs/Marker.h>
+#include <visualization_msgs/MarkerArray.h>
 #include <dynamic_reconfigure/server.h>
+#include <diagnostic_updater/diagnostic_updater.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 #include <algorithm>
+#include <deque>
+#include <sstream>
 
 using namespace std;
-using namespace laser_processor;
 using namespace ros;
 using namespace tf;
-using namespace estimation;
-using namespace BFL;
-using namespace MatrixWrapper;
-
+using leg_detector::CandidateBatch;
+using leg_detector::LegDetectorCore;
+using leg_detector::LegDetectorParams;
+using leg_detector::LegDetectorResult;
 
-static double no_observation_timeout_s = 0.5;
-static double max_second_leg_age_s     = 2.0;
-static double max_track_jump_m         = 1.0;
-static double max_meas_jump_m          = 0.75; // 1.0
-static double leg_pair_separation_m    = 1.0;
-static string fixed_frame              = "odom_combined";
 
-static double kal_p = 4, kal_q = .002, kal_r = 10;
-static bool use_filter = true;
+enum ScanPolicy {SCAN_POLICY_ALL = 0, SCAN_POLICY_LATEST = 1, SCAN_POLICY_BUDGET = 2};
 
 
-class SavedFeature
+// The candidate extraction state of one laser scanner, or of one ring of a lidar
+struct ChannelState
 {
-public:
-  static int nextid;
-  TransformListener& tfl_;
-
-  BFL::StatePosVel sys_sigma_;
-  TrackerKalman filter_;
-
-  string id_;
-  string object_id;
-  ros::Time time_;
-  ros::Time meas_time_;
-
-  double reliability, p;
-
-  Stamped<Point> position_;
-  SavedFeature* other;
-  float dist_to_person_;
-
-  // one leg tracker
-  SavedFeature(Stamped<Point> loc, TransformListener& tfl)
-    : tfl_(tfl),
-      sys_sigma_(Vector3(0.05, 0.05, 0.05), Vector3(1.0, 1.0, 1.0)),
-      filter_("tracker_name", sys_sigma_),
-      reliability(-1.), p(4)
+  int channel;
+  string name;
+  leg_detector::ScanChannel scan_channel;
+  CandidateBatch batch;
+  bool ready;               // batch holds the candidates of the current scan
+  std::string mask_file;
+  int mask_count;
+
+  ChannelState(int index, const string& channel_name)
+    : channel(index), name(channel_name), ready(false), mask_count(0)
   {
-    char id[100];
-    snprintf(id, 100, "legtrack%d", nextid++);
-    id_ = std::string(id);
-
-    object_id = "";
-    time_ = loc.stamp_;
-    meas_time_ = loc.stamp_;
-    other = NULL;
-
-    try
-    {
-      tfl_.transformPoint(fixed_frame, loc, loc);
-    }
-    catch (...)
-    {
-      ROS_WARN("TF exception spot 6.");
-    }
-    StampedTransform pose(Pose(Quaternion(0.0, 0.0, 0.0, 1.0), loc), loc.stamp_, id_, loc.frame_id_);
-    tfl_.setTransform(pose);
-
-    StatePosVel prior_sigma(Vector3(0.1, 0.1, 0.1), Vector3(0.0000001, 0.0000001, 0.0000001));
-    filter_.initialize(loc, prior_sigma, time_.toSec());
-
-    StatePosVel est;
-    filter_.getEstimate(est);
-
-    updatePosition();
+    batch.channel = index;
   }
+};
 
-  void propagate(ros::Time time)
-  {
-    time_ = time;
-
-    filter_.updatePrediction(time.toSec());
-
-    updatePosition();
-  }
-
-  void update(Stamped<Point> loc, double probability)
-  {
-    StampedTransform pose(Pose(Quaternion(0.0, 0.0, 0.0, 1.0), loc), loc.stamp_, id_, loc.frame_id_);
-    tfl_.setTransform(pose);
-
-    meas_time_ = loc.stamp_;
-    time_ = meas_time_;
+// One laser scanner: its subscription, admission queue and segmentation worker
+struct ScanSource
+{
+  string topic;
 
-    SymmetricMatrix cov(3);
-    cov = 0.0;
-    cov(1, 1) = 0.0025;
-    cov(2, 2) = 0.0025;
-    cov(3, 3) = 0.0025;
+  message_filters::Subscriber<sensor_msgs::LaserScan> sub;
+  tf::MessageFilter<sensor_msgs::LaserScan> notifier;
 
-    filter_.updateCorrection(loc, cov);
+  // Scans that passed the tf filter, guarded by LegDetector::scan_mutex_
+  deque<sensor_msgs::LaserScan::ConstPtr> queue;
+  boost::condition_variable cond;
+  boost::thread thread;
 
-    updatePosition();
+  // Only touched by the worker
+  ChannelState state;
 
-    if (reliability < 0 || !use_filter)
-    {
-      reliability = probability;
-      p = kal_p;
-    }
-    else
-    {
-      p += kal_q;
-      double k = p / (p + kal_r);
-      reliability += k * (probability - reliability);
-      p *= (1 - k);
-    }
-  }
-
-  double getLifetime()
-  {
-    return filter_.getLifetime();
-  }
-
-  double getReliability()
-  {
-    return reliability;
-  }
-
-private:
-  void updatePosition()
-  {
-    StatePosVel est;
-    filter_.getEstimate(est);
-
-    position_[0] = est.pos_[0];
-    position_[1] = est.pos_[1];
-    position_[2] = est.pos_[2];
-    position_.stamp_ = time_;
-    position_.frame_id_ = fixed_frame;
-    double nreliability = fmin(1.0, fmax(0.1, est.vel_.length() / 0.5));
-    //reliability = fmax(reliability, nreliability);
-  }
+  ScanSource(NodeHandle& nh, TransformListener& tfl, const string& fixed_frame, int index, const string& name)
+    : topic(name),
+      sub(nh, name, 10),
+      notifier(sub, tfl, fixed_frame, 10),
+      state(index, name)
+  {}
 };
 
-int SavedFeature::nextid = 0;
-
-
-
-
-class MatchedFeature
+// A multi-ring lidar. Each cloud is split into one virtual scan per ring, and the rings at leg
+// height are segmented in parallel by the ring workers together with the cloud thread.
+struct CloudSource
 {
-public:
-  SampleSet* candidate_;
-  SavedFeature* closest_;
-  float distance_;
-  double probability_;
-
-  MatchedFeature(SampleSet* candidate, SavedFeature* closest, float distance, double probability)
-    : candidate_(candidate)
-    , closest_(closest)
-    , distance_(distance)
-    , probability_(probability)
+  string topic;
+
+  message_filters::Subscriber<sensor_msgs::PointCloud2> sub;
+  tf::MessageFilter<sensor_msgs::PointCloud2> notifier;
+
+  // Clouds that passed the tf filter, guarded by LegDetector::scan_mutex_
+  deque<sensor_msgs::PointCloud2::ConstPtr> queue;
+  boost::condition_variable cond;
+  boost::thread thread;
+
+  // Only touched by the cloud thread, and read by the ring workers while they run
+  leg_detector::CloudRings rings;
+  vector<int> fixed_rings;  // the rings to use, empty to pick them by height
+  double min_height, max_height;
+  int first_channel;
+  vector<boost::shared_ptr<ChannelState> > channels;
+  LegDetectorParams params;
+  vector<tf::Vector3> tracks;
+  StampedTransform sensor_pose;
+  double deadline;
+
+  // The rings of the current cloud, guarded by job_mutex
+  boost::thread_group workers;
+  boost::mutex job_mutex;
+  boost::condition_variable job_cond, done_cond;
+  vector<int> jobs;
+  size_t next_job, jobs_done;
+  unsigned long generation;
+
+  CloudSource(NodeHandle& nh, TransformListener& tfl, const string& fixed_frame, int channel, const string& name,
+              int beams)
+    : topic(name),
+      sub(nh, name, 2),
+      notifier(sub, tfl, fixed_frame, 2),
+      rings(beams),
+      min_height(0.1), max_height(0.6),
+      first_channel(channel),
+      deadline(0.0),
+      next_job(0), jobs_done(0), generation(0)
   {}
-
-  inline bool operator< (const MatchedFeature& b) const
-  {
-    return (distance_ <  b.distance_);
-  }
 };
 
-int g_argc;
-char** g_argv;
-
 
-
-
-// actual legdetector node
+// actual legdetector node, feeding scans from ROS into LegDetectorCore and publishing its results
 class LegDetector
 {
 public:
@@ -240,635 +171,826 @@ public:
 
   TransformListener tfl_;
 
-  ScanMask mask_;
-
-  int mask_count_;
-
-  CvRTrees forest;
-
-  float connected_thresh_;
+  LegDetectorCore core_;
+  boost::mutex core_mutex_;
 
-  int feat_count_;
+  string fixed_frame_;
 
-  char save_[100];
-
-  list<SavedFeature*> saved_features_;
-  boost::mutex saved_mutex_;
-
-  int feature_id_;
-
-  bool use_seeds_;
-  bool publish_legs_, publish_people_, publish_leg_markers_, publish_people_markers_;
-  int next_p_id_;
+  bool publish_legs_, publish_people_, publish_leg_markers_, publish_people_markers_, publish_people_velocity_;
   double leg_reliability_limit_;
-  int min_points_per_group;
 
   ros::Publisher people_measurements_pub_;
   ros::Publisher leg_measurements_pub_;
   ros::Publisher markers_pub_;
+  ros::Publisher people_pub_;
+
+  // Scanners, each with its own queue and worker thread. Their candidates are tracked together
+  // by whichever worker gets core_mutex_ first.
+  vector<boost::shared_ptr<ScanSource> > sources_;
+  boost::shared_ptr<CloudSource> cloud_;
+  boost::mutex scan_mutex_;
+  int scan_policy_;
+  double scan_time_budget_;
+  unsigned int scan_queue_size_;
+
+  // Admission accounting, guarded by scan_mutex_
+  unsigned long scans_received_, scans_processed_, scans_dropped_, scans_coalesced_;
+  leg_detector::RollingPercentiles scan_latency_;
+  size_t cloud_rings_used_;
+
+  // Deadline accounting, guarded by scan_mutex_
+  double scan_deadline_;
+  unsigned long scans_degraded_, skipped_clusters_, degrade_steps_[3];
+
+  // Batches waiting for a tracking pass, at most one per scanner, guarded by batch_mutex_
+  vector<CandidateBatch> pending_batches_;
+  boost::mutex batch_mutex_;
+
+  // Guarded by core_mutex_
+  LegDetectorResult result_;
+  vector<CandidateBatch> batches_;
+  double publish_time_;
+  std::string mask_file_;
+  int mask_scans_;
+  FILE* detections_;        // every pass is written here if set, as leg_detector_replay -o writes it
+
+  // Background classifier loading, guarded by model_mutex_
+  boost::thread model_thread_;
+  boost::mutex model_mutex_;
+  std::string model_file_, model_error_;
+
+  diagnostic_updater::Updater updater_;
 
   dynamic_reconfigure::Server<leg_detector::LegDetectorConfig> server_;
 
   message_filters::Subscriber<people_msgs::PositionMeasurement> people_sub_;
-  message_filters::Subscriber<sensor_msgs::LaserScan> laser_sub_;
   tf::MessageFilter<people_msgs::PositionMeasurement> people_notifier_;
-  tf::MessageFilter<sensor_msgs::LaserScan> laser_notifier_;
 
-  LegDetector(ros::NodeHandle nh) :
+  LegDetector(ros::NodeHandle nh, ros::NodeHandle private_nh, const std::string& model_file) :
     nh_(nh),
-    mask_count_(0),
-    feat_count_(0),
-    next_p_id_(0),
+    fixed_frame_("odom_combined"),
+    scan_policy_(SCAN_POLICY_ALL),
+    scan_time_budget_(0.1),
+    scan_queue_size_(10),
+    scans_received_(0),
+    scans_processed_(0),
+    scans_dropped_(0),
+    scans_coalesced_(0),
+    cloud_rings_used_(0),
+    scan_deadline_(0.0),
+    scans_degraded_(0),
+    skipped_clusters_(0),
+    publish_time_(0.0),
+    detections_(NULL),
+    updater_(nh, private_nh),
+    server_(private_nh),
     people_sub_(nh_, "people_tracker_filter", 10),
-    laser_sub_(nh_, "scan", 10),
-    people_notifier_(people_sub_, tfl_, fixed_frame, 10),
-    laser_notifier_(laser_sub_, tfl_, fixed_frame, 10)
+    people_notifier_(people_sub_, tfl_, fixed_frame_, 10)
   {
-    if (g_argc > 1)
+    for (int step = 0; step < 3; step++)
+      degrade_steps_[step] = 0;
+
+    std::string error;
+    model_file_ = model_file;
+    if (model_file.empty())
+      ROS_ERROR("Please provide a trained random forests classifier as an input.");
+    else if (core_.loadModel(model_file, &error))
+      printf("Loaded forest with %d features: %s\n", core_.getFeatureCount(), model_file.c_str());
+    else
     {
-      forest.load(g_argv[1]);
-      feat_count_ = forest.get_active_var_mask()->cols;
-      printf("Loaded forest with %d features: %s\n", feat_count_, g_argv[1]);
+      ROS_ERROR("Could not load a random forests classifier: %s", error.c_str());
+      model_error_ = error;
     }
-    else
+
+    LegDetectorParams params;
+    nh_.param<bool>("use_seeds", params.use_seeds, !true);
+    core_.setParams(params);
+
+    // Every scanner gets its own mask and worker, their legs end up in one set of tracks
+    vector<string> topics;
+    std::string cloud_topic;
+    private_nh.param<std::string>("cloud_topic", cloud_topic, "");
+    if ((!private_nh.getParam("scan_topics", topics) || topics.empty()) && cloud_topic.empty())
+      topics.assign(1, "scan");
+
+    // A saved background mask is used as is, otherwise one is built from the first mask_scans scans.
+    // With several scanners, each mask file is suffixed with its topic, and with the ring of a lidar.
+    private_nh.param<std::string>("mask_file", mask_file_, "");
+    private_nh.param<int>("mask_scans", mask_scans_, 0);
+
+    // For comparing the node with leg_detector_replay on the same bag
+    std::string detections_file;
+    private_nh.param<std::string>("detections_file", detections_file, "");
+    if (!detections_file.empty() && (detections_ = fopen(detections_file.c_str(), "w")) == NULL)
+      ROS_ERROR("Could not open %s for writing", detections_file.c_str());
+
+    for (size_t i = 0; i < topics.size(); i++)
     {
-      printf("Please provide a trained random forests classifier as an input.\n");
-      shutdown();
+      boost::shared_ptr<ScanSource> source(new ScanSource(nh_, tfl_, fixed_frame_, i, topics[i]));
+      string suffix = topics[i];
+      replace(suffix.begin(), suffix.end(), '/', '_');
+      loadMask(source->state, topics.size() > 1 ? "." + suffix : "");
+      sources_.push_back(source);
     }
 
-    nh_.param<bool>("use_seeds", use_seeds_, !true);
+    if (!cloud_topic.empty())
+    {
+      int beams, threads;
+      private_nh.param<int>("cloud_beams", beams, 1024);
+      private_nh.param<int>("cloud_threads", threads, 4);
+      cloud_.reset(new CloudSource(nh_, tfl_, fixed_frame_, topics.size(), cloud_topic, beams));
+      private_nh.getParam("cloud_rings", cloud_->fixed_rings);
+      private_nh.param<double>("leg_height_min", cloud_->min_height, 0.1);
+      private_nh.param<double>("leg_height_max", cloud_->max_height, 0.6);
+
+      // The cloud thread segments rings as well
+      for (int t = 1; t < threads; t++)
+        cloud_->workers.create_thread(boost::bind(&LegDetector::ringLoop, this, cloud_.get()));
+    }
 
     // advertise topics
     leg_measurements_pub_ = nh_.advertise<people_msgs::PositionMeasurementArray>("leg_tracker_measurements", 0);
     people_measurements_pub_ = nh_.advertise<people_msgs::PositionMeasurementArray>("people_tracker_measurements", 0);
-    markers_pub_ = nh_.advertise<visualization_msgs::Marker>("visualization_marker", 20);
+    markers_pub_ = nh_.advertise<visualization_msgs::MarkerArray>("visualization_marker_array", 20);
+    people_pub_ = nh_.advertise<people_msgs::People>("people", 10);
 
-    if (use_seeds_)
+    if (params.use_seeds)
     {
       people_notifier_.registerCallback(boost::bind(&LegDetector::peopleCallback, this, _1));
       people_notifier_.setTolerance(ros::Duration(0.01));
     }
-    laser_notifier_.registerCallback(boost::bind(&LegDetector::laserCallback, this, _1));
-    laser_notifier_.setTolerance(ros::Duration(0.01));
+    for (size_t i = 0; i < sources_.size(); i++)
+    {
+      ScanSource* source = sources_[i].get();
+      source->notifier.registerCallback(boost::bind(&LegDetector::laserCallback, this, source, _1));
+      source->notifier.setTolerance(ros::Duration(0.01));
+    }
+    if (cloud_)
+    {
+      cloud_->notifier.registerCallback(boost::bind(&LegDetector::cloudCallback, this, cloud_.get(), _1));
+      cloud_->notifier.setTolerance(ros::Duration(0.01));
+    }
 
     dynamic_reconfigure::Server<leg_detector::LegDetectorConfig>::CallbackType f;
     f = boost::bind(&LegDetector::configure, this, _1, _2);
     server_.setCallback(f);
 
-    feature_id_ = 0;
+    updater_.setHardwareID("none");
+    updater_.add("Scan admission", this, &LegDetector::scanDiagnostics);
+    updater_.add("Leg tracks", this, &LegDetector::trackDiagnostics);
+    updater_.add("Scan deadline", this, &LegDetector::deadlineDiagnostics);
+    updater_.add("Classifier", this, &LegDetector::modelDiagnostics);
+#if LEG_DETECTOR_PROFILING
+    updater_.add("Scan processing", this, &LegDetector::profileDiagnostics);
+#endif
+
+    for (size_t i = 0; i < sources_.size(); i++)
+      sources_[i]->thread = boost::thread(boost::bind(&LegDetector::scanLoop, this, sources_[i].get()));
+    if (cloud_)
+      cloud_->thread = boost::thread(boost::bind(&LegDetector::cloudLoop, this, cloud_.get()));
   }
 
 
   ~LegDetector()
   {
+    for (size_t i = 0; i < sources_.size(); i++)
+      sources_[i]->thread.interrupt();
+    if (cloud_)
+    {
+      cloud_->thread.interrupt();
+      cloud_->workers.interrupt_all();
+    }
+    for (size_t i = 0; i < sources_.size(); i++)
+      sources_[i]->thread.join();
+    if (cloud_)
+    {
+      cloud_->thread.join();
+      cloud_->workers.join_all();
+    }
+    model_thread_.join();
+    if (detections_)
+      fclose(detections_);
   }
 
   void configure(leg_detector::LegDetectorConfig &config, uint32_t level)
   {
-    connected_thresh_       = config.connection_threshold;
-    min_points_per_group    = config.min_points_per_group;
-    leg_reliability_limit_  = config.leg_reliability_limit;
-    publish_legs_           = config.publish_legs;
-    publish_people_         = config.publish_people;
-    publish_leg_markers_    = config.publish_leg_markers;
-    publish_people_markers_ = config.publish_people_markers;
-
-    no_observation_timeout_s = config.no_observation_timeout;
-    max_second_leg_age_s     = config.max_second_leg_age;
-    max_track_jump_m         = config.max_track_jump;
-    max_meas_jump_m          = config.max_meas_jump;
-    leg_pair_separation_m    = config.leg_pair_separation;
-    if (fixed_frame.compare(config.fixed_frame) != 0)
-    {
-      fixed_frame              = config.fixed_frame;
-      laser_notifier_.setTargetFrame(fixed_frame);
-      people_notifier_.setTargetFrame(fixed_frame);
-    }
-
-    kal_p                    = config.kalman_p;
-    kal_q                    = config.kalman_q;
-    kal_r                    = config.kalman_r;
-    use_filter               = config.kalman_on == 1;
+    // A new classifier is loaded in the background and swapped in between scans, tracks are kept
+    if (!config.model_file.empty() && config.model_file != model_file_)
+    {
+      model_thread_.join();
+      {
+        boost::mutex::scoped_lock lock(model_mutex_);
+        model_file_ = config.model_file;
+      }
+      model_thread_ = boost::thread(boost::bind(&LegDetector::loadModel, this, config.model_file));
+    }
+
+    boost::mutex::scoped_lock core_lock(core_mutex_);
+
+    LegDetectorParams params = core_.getParams();
+    params.connected_thresh       = config.connection_threshold;
+    params.min_points_per_group   = config.min_points_per_group;
+    params.leg_reliability_limit  = config.leg_reliability_limit;
+    params.no_observation_timeout = config.no_observation_timeout;
+    params.max_second_leg_age     = config.max_second_leg_age;
+    params.max_track_jump         = config.max_track_jump;
+    params.max_meas_jump          = config.max_meas_jump;
+    params.leg_pair_separation    = config.leg_pair_separation;
+    params.kal_p                  = config.kalman_p;
+    params.kal_q                  = config.kalman_q;
+    params.kal_r                  = config.kalman_r;
+    params.use_filter             = config.kalman_on == 1;
+    params.roi_full_scan_interval = config.roi_full_scan_interval;
+    params.roi_change_threshold   = config.roi_change_threshold;
+    params.reuse_max_scans        = config.reuse_max_scans;
+    params.reuse_min_reliability  = config.reuse_min_reliability;
+    params.reuse_feature_drift    = config.reuse_feature_drift;
+    params.max_tracks             = config.max_tracks;
+    params.birth_probability      = config.birth_probability;
+    params.scan_deadline          = config.scan_deadline;
+    params.fusion_distance        = config.fusion_distance;
+    core_.setParams(params);
+
+    leg_reliability_limit_   = config.leg_reliability_limit;
+    publish_legs_            = config.publish_legs;
+    publish_people_          = config.publish_people;
+    publish_leg_markers_     = config.publish_leg_markers;
+    publish_people_markers_  = config.publish_people_markers;
+    publish_people_velocity_ = config.publish_people_velocity;
+
+    if (fixed_frame_.compare(config.fixed_frame) != 0)
+    {
+      fixed_frame_             = config.fixed_frame;
+      for (size_t i = 0; i < sources_.size(); i++)
+        sources_[i]->notifier.setTargetFrame(fixed_frame_);
+      if (cloud_)
+        cloud_->notifier.setTargetFrame(fixed_frame_);
+      people_notifier_.setTargetFrame(fixed_frame_);
+    }
+
+    boost::mutex::scoped_lock lock(scan_mutex_);
+    scan_policy_             = config.scan_policy;
+    scan_time_budget_        = config.scan_time_budget;
+    scan_queue_size_         = config.scan_queue_size;
+    scan_deadline_           = config.scan_deadline;
   }
 
-  double distance(list<SavedFeature*>::iterator it1,  list<SavedFeature*>::iterator it2)
+  void scanDiagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat)
   {
-    Stamped<Point> one = (*it1)->position_, two = (*it2)->position_;
-    double dx = one[0] - two[0], dy = one[1] - two[1], dz = one[2] - two[2];
-    return sqrt(dx * dx + dy * dy + dz * dz);
+    boost::mutex::scoped_lock lock(scan_mutex_);
+
+    if (scans_dropped_ + scans_coalesced_ > 0)
+      stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Processing is skipping scans to keep up");
+    else
+      stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Processing every scan");
+
+    size_t queued = 0;
+    for (size_t i = 0; i < sources_.size(); i++)
+      queued += sources_[i]->queue.size();
+    if (cloud_)
+      queued += cloud_->queue.size();
+
+    stat.add("Policy", scan_policy_);
+    stat.add("Scanners", sources_.size());
+    if (cloud_)
+      stat.add("Cloud rings used", cloud_rings_used_);
+    stat.add("Scans received", scans_received_);
+    stat.add("Scans processed", scans_processed_);
+    stat.add("Scans dropped", scans_dropped_);
+    stat.add("Scans coalesced", scans_coalesced_);
+    stat.add("Queue length", queued);
+    stat.add("Latency p50 [s]", scan_latency_.percentile(0.5));
+    stat.add("Latency p90 [s]", scan_latency_.percentile(0.9));
+    stat.add("Latency p99 [s]", scan_latency_.percentile(0.99));
+    stat.add("Latency max [s]", scan_latency_.max());
   }
 
-  // Find the tracker that is closest to this person message
-  // If a tracker was already assigned to a person, keep this assignment when the distance between them is not too large.
-  void peopleCallback(const people_msgs::PositionMeasurement::ConstPtr& people_meas)
+  void loadModel(const std::string& file)
   {
-    // If there are no legs, return.
-    if (saved_features_.empty())
-      return;
+    std::string error;
+    CvRTrees* forest = LegDetectorCore::readModel(file, error);
 
-    Point pt;
-    pointMsgToTF(people_meas->pos, pt);
-    Stamped<Point> person_loc(pt, people_meas->header.stamp, people_meas->header.frame_id);
-    person_loc[2] = 0.0; // Ignore the height of the person measurement.
-    Stamped<Point> dest_loc(pt, people_meas->header.stamp, people_meas->header.frame_id); // Holder for all transformed pts.
+    boost::mutex::scoped_lock lock(model_mutex_);
+    if (forest != NULL)
+    {
+      core_.offerModel(forest);
+      model_error_.clear();
+      ROS_INFO("Loaded forest from %s, it is used from the next scan on", file.c_str());
+    }
+    else
+    {
+      model_error_ = error;
+      ROS_ERROR("Could not load a random forests classifier: %s", error.c_str());
+    }
+  }
+
+  void modelDiagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat)
+  {
+    boost::mutex::scoped_lock lock(model_mutex_);
+
+    if (core_.getFeatureCount() == 0)
+      stat.summary(diagnostic_msgs::DiagnosticStatus::ERROR, "No classifier loaded");
+    else if (!model_error_.empty())
+      stat.summary(diagnostic_msgs::DiagnosticStatus::WARN, "Could not load the requested classifier");
+    else
+      stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Classifier loaded");
 
-    boost::mutex::scoped_lock lock(saved_mutex_);
+    stat.add("Model file", model_file_);
+    stat.add("Models swapped", core_.getModelSwapCount());
+    stat.add("Last error", model_error_);
+  }
+
+  void deadlineDiagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat)
+  {
+    boost::mutex::scoped_lock lock(scan_mutex_);
+
+    if (scan_deadline_ <= 0)
+      stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "No scan deadline");
+    else if (scans_degraded_ > 0)
+      stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Degrading scans to meet the deadline");
+    else
+      stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Meeting the scan deadline");
+
+    stat.add("Deadline [s]", scan_deadline_);
+    stat.add("Scans degraded", scans_degraded_);
+    stat.add("Far clusters skipped", degrade_steps_[0]);
+    stat.add("Clusters skipped", skipped_clusters_);
+    stat.add("Pairing skipped", degrade_steps_[1]);
+    stat.add("Markers skipped", degrade_steps_[2]);
+  }
 
-    list<SavedFeature*>::iterator closest = saved_features_.end();
-    list<SavedFeature*>::iterator closest1 = saved_features_.end();
-    list<SavedFeature*>::iterator closest2 = saved_features_.end();
-    float closest_dist = max_meas_jump_m;
-    float closest_pair_dist = 2 * max_meas_jump_m;
+  void trackDiagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat)
+  {
+    const LegDetectorParams& params = core_.getParams();
+    size_t tracks = core_.getTrackCount();
 
-    list<SavedFeature*>::iterator begin = saved_features_.begin();
-    list<SavedFeature*>::iterator end = saved_features_.end();
-    list<SavedFeature*>::iterator it1, it2;
+    if (params.max_tracks > 0 && (int)tracks >= params.max_tracks)
+      stat.summary(diagnostic_msgs::DiagnosticStatus::WARN, "Leg track budget is full");
+    else
+      stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Leg tracks within budget");
+
+    stat.add("Tracks", tracks);
+    stat.add("Peak tracks", core_.getPeakTrackCount());
+    stat.add("Max tracks", params.max_tracks);
+    stat.add("Evicted tracks", core_.getEvictedTrackCount());
+    stat.add("Rejected births", core_.getRejectedBirthCount());
+    stat.add("Late batches", core_.getLateBatchCount());
+  }
 
-    // If there's a pair of legs with the right label and within the max dist, return
-    // If there's one leg with the right label and within the max dist,
-    //   find a partner for it from the unlabeled legs whose tracks are reasonably new.
-    //   If no partners exist, label just the one leg.
-    // If there are no legs with the right label and within the max dist,
-    //   find a pair of unlabeled legs and assign them the label.
-    // If all of the above cases fail,
-    //   find a new unlabeled leg and assign the label.
+  void profileDiagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat)
+  {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Per-stage processing time");
 
-    // For each tracker, get the distance to this person.
-    for (it1 = begin; it1 != end; ++it1)
+    const leg_detector::ScanProfiler& profiler = core_.getProfiler();
+    stat.add("Scans", profiler.scans);
+    stat.add("Total p50 [ms]", profiler.total_time.percentile(0.5) * 1e3);
+    stat.add("Total p99 [ms]", profiler.total_time.percentile(0.99) * 1e3);
+    for (int i = 0; i < leg_detector::NUM_SCAN_STAGES; i++)
     {
-      try
-      {
-        tfl_.transformPoint((*it1)->id_, people_meas->header.stamp,
-                            person_loc, fixed_frame, dest_loc);
-        //ROS_INFO("Succesful leg transformation at spot 7");
-      }
-      catch (...)
-      {
-        ROS_WARN("TF exception spot 7.");
-      }
-      (*it1)->dist_to_person_ = dest_loc.length();
+      string name = leg_detector::scanStageName(i);
+      stat.add(name + " p50 [ms]", profiler.stage_time[i].percentile(0.5) * 1e3);
+      stat.add(name + " p99 [ms]", profiler.stage_time[i].percentile(0.99) * 1e3);
     }
+    stat.add("Beams p50", profiler.beams.percentile(0.5));
+    stat.add("Clusters p50", profiler.clusters.percentile(0.5));
+    stat.add("Clusters max", profiler.clusters.max());
+    stat.add("Reused classifications p50", profiler.reused.percentile(0.5));
+    stat.add("Tracks p50", profiler.tracks.percentile(0.5));
+    stat.add("Tracks max", profiler.tracks.max());
+    stat.add("Segmentation allocations p50", profiler.allocations.percentile(0.5));
+    stat.add("Segmentation allocations max", profiler.allocations.max());
+  }
 
-    // Try to find one or two trackers with the same label and within the max distance of the person.
-    cout << "Looking for two legs" << endl;
-    it2 = end;
-    for (it1 = begin; it1 != end; ++it1)
+  // Hand a person estimate from the people tracker to the core, which labels the legs closest to it.
+  void peopleCallback(const people_msgs::PositionMeasurement::ConstPtr& people_meas)
+  {
+    Point pt;
+    pointMsgToTF(people_meas->pos, pt);
+    Stamped<Point> person_loc(pt, people_meas->header.stamp, people_meas->header.frame_id);
+    person_loc[2] = 0.0; // Ignore the height of the person measurement.
+    Stamped<Point> dest_loc(pt, people_meas->header.stamp, people_meas->header.frame_id);
+    try
     {
-      // If this leg belongs to the person...
-      if ((*it1)->object_id == people_meas->object_id)
-      {
-        // and their distance is close enough...
-        if ((*it1)->dist_to_person_ < max_meas_jump_m)
-        {
-          // if this is the first leg we've found, assign it to it2. Otherwise, leave it assigned to it1 and break.
-          if (it2 == end)
-            it2 = it1;
-          else
-            break;
-        }
-        // Otherwise, remove the tracker's label, it doesn't belong to this person.
-        else
-        {
-          // the two trackers moved apart. This should not happen.
-          (*it1)->object_id = "";
-        }
-      }
+      tfl_.transformPoint(fixed_frame_, person_loc, dest_loc);
     }
-    // If we found two legs with the right label and within the max distance, all is good, return.
-    if (it1 != end && it2 != end)
+    catch (...)
     {
-      cout << "Found matching pair. The second distance was " << (*it1)->dist_to_person_ << endl;
+      ROS_WARN("TF exception spot 7.");
       return;
     }
 
+    boost::mutex::scoped_lock lock(core_mutex_);
+    core_.seedPerson(people_meas->object_id, dest_loc);
+  }
 
+  // Admit a scan or cloud into the queue of its source according to the configured policy.
+  template <class Message>
+  void admit(deque<boost::shared_ptr<const Message> >& queue, boost::condition_variable& cond,
+             const boost::shared_ptr<const Message>& message)
+  {
+    boost::mutex::scoped_lock lock(scan_mutex_);
+    scans_received_++;
 
-    // If we only found one close leg with the right label, let's try to find a second leg that
-    //   * doesn't yet have a label  (=valid precondition),
-    //   * is within the max distance,
-    //   * is less than max_second_leg_age_s old.
-    cout << "Looking for one leg plus one new leg" << endl;
-    float dist_between_legs, closest_dist_between_legs;
-    if (it2 != end)
+    if (scan_policy_ == SCAN_POLICY_LATEST)
     {
-      closest_dist = max_meas_jump_m;
-      closest = saved_features_.end();
-
-      for (it1 = begin; it1 != end; ++it1)
-      {
-        // Skip this leg track if:
-        // - you're already using it.
-        // - it already has an id.
-        // - it's too old. Old unassigned trackers are unlikely to be the second leg in a pair.
-        // - it's too far away from the person.
-        if ((it1 == it2) || ((*it1)->object_id != "") || ((*it1)->getLifetime() > max_second_leg_age_s) || ((*it1)->dist_to_person_ >= closest_dist))
-          continue;
-
-        // Get the distance between the two legs
-        try
-        {
-          tfl_.transformPoint((*it1)->id_, (*it2)->position_.stamp_, (*it2)->position_, fixed_frame, dest_loc);
-        }
-        catch (...)
-        {
-          ROS_WARN("TF exception getting distance between legs.");
-        }
-        dist_between_legs = dest_loc.length();
-
-        // If this is the closest dist (and within range), and the legs are close together and unlabeled, mark it.
-        if (dist_between_legs < leg_pair_separation_m)
-        {
-          closest = it1;
-          closest_dist = (*it1)->dist_to_person_;
-          closest_dist_between_legs = dist_between_legs;
-        }
-      }
-      // If we found a close, unlabeled leg, set it's label.
-      if (closest != end)
-      {
-        cout << "Replaced one leg with a distance of " << closest_dist << " and a distance between the legs of " << closest_dist_between_legs << endl;
-        (*closest)->object_id = people_meas->object_id;
-      }
-      else
+      // Only the newest scan is worth processing, anything still waiting is superseded.
+      scans_coalesced_ += queue.size();
+      queue.clear();
+    }
+    else
+    {
+      while (queue.size() >= scan_queue_size_)
       {
-        cout << "Returned one matched leg only" << endl;
+        queue.pop_front();
+        scans_dropped_++;
       }
-
-      // Regardless of whether we found a second leg, return.
-      return;
     }
 
-    cout << "Looking for a pair of new legs" << endl;
-    // If we didn't find any legs with this person's label, try to find two unlabeled legs that are close together and close to the tracker.
-    it1 = saved_features_.begin();
-    it2 = saved_features_.begin();
-    closest = saved_features_.end();
-    closest1 = saved_features_.end();
-    closest2 = saved_features_.end();
-    closest_dist = max_meas_jump_m;
-    closest_pair_dist = 2 * max_meas_jump_m;
-    for (; it1 != end; ++it1)
-    {
-      // Only look at trackers without ids and that are not too far away.
-      if ((*it1)->object_id != "" || (*it1)->dist_to_person_ >= max_meas_jump_m)
-        continue;
+    queue.push_back(message);
+    cond.notify_one();
+  }
 
-      // Keep the single closest leg around in case none of the pairs work out.
-      if ((*it1)->dist_to_person_ < closest_dist)
+  // Take the next admissible scan or cloud of a source, skipping those that exceeded the time budget.
+  template <class Message>
+  boost::shared_ptr<const Message> next(deque<boost::shared_ptr<const Message> >& queue,
+                                        boost::condition_variable& cond)
+  {
+    boost::mutex::scoped_lock lock(scan_mutex_);
+    while (queue.empty())
+      cond.wait(lock);
+
+    if (scan_policy_ == SCAN_POLICY_BUDGET)
+    {
+      // Never drop the newest scan, a stale result is still better than none at all.
+      ros::Time now = ros::Time::now();
+      while (queue.size() > 1
+             && (now - queue.front()->header.stamp).toSec() > scan_time_budget_)
       {
-        closest_dist = (*it1)->dist_to_person_;
-        closest = it1;
+        queue.pop_front();
+        scans_dropped_++;
       }
+    }
 
-      // Find a second leg.
-      it2 = it1;
-      it2++;
-      for (; it2 != end; ++it2)
-      {
-        // Only look at trackers without ids and that are not too far away.
-        if ((*it2)->object_id != "" || (*it2)->dist_to_person_ >= max_meas_jump_m)
-          continue;
+    boost::shared_ptr<const Message> message = queue.front();
+    queue.pop_front();
+    return message;
+  }
 
-        // Get the distance between the two legs
-        try
-        {
-          tfl_.transformPoint((*it1)->id_, (*it2)->position_.stamp_, (*it2)->position_, fixed_frame, dest_loc);
-        }
-        catch (...)
-        {
-          ROS_WARN("TF exception getting distance between legs in spot 2.");
-        }
-        dist_between_legs = dest_loc.length();
+  void laserCallback(ScanSource* source, const sensor_msgs::LaserScan::ConstPtr& scan)
+  {
+    admit(source->queue, source->cond, scan);
+  }
 
-        // Ensure that this pair of legs is the closest pair to the tracker, and that the distance between the legs isn't too large.
-        if ((*it1)->dist_to_person_ + (*it2)->dist_to_person_ < closest_pair_dist && dist_between_legs < leg_pair_separation_m)
-        {
-          closest_pair_dist = (*it1)->dist_to_person_ + (*it2)->dist_to_person_;
-          closest1 = it1;
-          closest2 = it2;
-          closest_dist_between_legs = dist_between_legs;
-        }
+  void cloudCallback(CloudSource* source, const sensor_msgs::PointCloud2::ConstPtr& cloud)
+  {
+    admit(source->queue, source->cond, cloud);
+  }
+
+  void scanLoop(ScanSource* source)
+  {
+    try
+    {
+      while (ros::ok())
+      {
+        sensor_msgs::LaserScan::ConstPtr scan = next(source->queue, source->cond);
+        if (extractCandidates(*source, scan))
+          track();
+        processed(scan->header.stamp);
       }
     }
-    // Found a pair of legs.
-    if (closest1 != end && closest2 != end)
+    catch (boost::thread_interrupted&)
     {
-      (*closest1)->object_id = people_meas->object_id;
-      (*closest2)->object_id = people_meas->object_id;
-      cout << "Found a completely new pair with total distance " << closest_pair_dist << " and a distance between the legs of " << closest_dist_between_legs << endl;
-      return;
     }
+  }
 
-    cout << "Looking for just one leg" << endl;
-    // No pair worked, try for just one leg.
-    if (closest != end)
+  void cloudLoop(CloudSource* source)
+  {
+    try
+    {
+      while (ros::ok())
+      {
+        sensor_msgs::PointCloud2::ConstPtr cloud = next(source->queue, source->cond);
+        if (extractCandidates(*source, cloud))
+          track();
+        processed(cloud->header.stamp);
+      }
+    }
+    catch (boost::thread_interrupted&)
     {
-      (*closest)->object_id = people_meas->object_id;
-      cout << "Returned one new leg only" << endl;
-      return;
     }
+  }
 
-    cout << "Nothing matched" << endl;
+  void processed(const ros::Time& stamp)
+  {
+    double latency = (ros::Time::now() - stamp).toSec();
+    boost::mutex::scoped_lock lock(scan_mutex_);
+    scans_processed_++;
+    scan_latency_.add(latency);
   }
 
-  void pairLegs()
+  // Copy what a worker needs from the core. The region of interest follows the tracks as of the
+  // last tracking pass. Returns false without a classifier.
+  bool snapshot(LegDetectorParams& params, std::string& fixed_frame, vector<tf::Vector3>& tracks)
   {
-    // Deal With legs that already have ids
-    list<SavedFeature*>::iterator begin = saved_features_.begin();
-    list<SavedFeature*>::iterator end = saved_features_.end();
-    list<SavedFeature*>::iterator leg1, leg2, best, it;
+    boost::mutex::scoped_lock lock(core_mutex_);
+    if (core_.getFeatureCount() == 0)
+      return false;
+    params = core_.getParams();
+    fixed_frame = fixed_frame_;
+    core_.getTrackPositions(tracks);
+    return true;
+  }
 
-    for (leg1 = begin; leg1 != end; ++leg1)
+  void loadMask(ChannelState& state, const std::string& suffix)
+  {
+    if (mask_file_.empty())
+      return;
+    state.mask_file = mask_file_ + suffix;
+    if (state.scan_channel.mask.load(state.mask_file))
     {
-      // If this leg has no id, skip
-      if ((*leg1)->object_id == "")
-        continue;
-
-      leg2 = end;
-      best = end;
-      double closest_dist = leg_pair_separation_m;
-      for (it = begin; it != end; ++it)
-      {
-        if (it == leg1) continue;
-
-        if ((*it)->object_id == (*leg1)->object_id)
-        {
-          leg2 = it;
-          break;
-        }
-
-        if ((*it)->object_id != "")
-          continue;
-
-        double d = distance(it, leg1);
-        if (((*it)->getLifetime() <= max_second_leg_age_s)
-            && (d < closest_dist))
-        {
-          closest_dist = d;
-          best = it;
-        }
+      ROS_INFO("Loaded scan mask for %s from %s", state.name.c_str(), state.mask_file.c_str());
+      state.mask_count = mask_scans_;
+    }
+  }
 
-      }
+  // Scans that build the mask are background, they are not searched for legs. Returns true if the
+  // scan went into the mask.
+  bool addToMask(ChannelState& state, const sensor_msgs::LaserScan& scan)
+  {
+    laser_processor::ScanMask& mask = state.scan_channel.mask;
+    if (!mask.empty() && !mask.matches(scan))
+    {
+      ROS_WARN("The scan mask does not match the geometry of %s scans, discarding it", state.name.c_str());
+      mask.clear();
+      state.mask_count = 0;
+    }
+    if (state.mask_count >= mask_scans_)
+      return false;
 
-      if (leg2 != end)
-      {
-        double dist_between_legs = distance(leg1, leg2);
-        if (dist_between_legs > leg_pair_separation_m)
-        {
-          (*leg1)->object_id = "";
-          (*leg1)->other = NULL;
-          (*leg2)->object_id = "";
-          (*leg2)->other = NULL;
-        }
-        else
-        {
-          (*leg1)->other = *leg2;
-          (*leg2)->other = *leg1;
-        }
-      }
-      else if (best != end)
-      {
-        (*best)->object_id = (*leg1)->object_id;
-        (*leg1)->other = *best;
-        (*best)->other = *leg1;
-      }
+    mask.addScan(scan);
+    if (++state.mask_count == mask_scans_ && !state.mask_file.empty())
+    {
+      if (mask.save(state.mask_file))
+        ROS_INFO("Saved scan mask for %s to %s", state.name.c_str(), state.mask_file.c_str());
+      else
+        ROS_WARN("Could not save the scan mask to %s", state.mask_file.c_str());
     }
+    return true;
+  }
 
-    // Attempt to pair up legs with no id
-    for (;;)
+  // Hand the batch of a channel to the next tracking pass. A batch still waiting from the same
+  // channel is superseded.
+  void queueBatch(ChannelState& state)
+  {
+    boost::mutex::scoped_lock lock(batch_mutex_);
+    size_t b = 0;
+    while (b < pending_batches_.size() && pending_batches_[b].channel != state.channel)
+      b++;
+    if (b == pending_batches_.size())
+      pending_batches_.push_back(CandidateBatch());
+    else
     {
-      list<SavedFeature*>::iterator best1 = end, best2 = end;
-      double closest_dist = leg_pair_separation_m;
+      boost::mutex::scoped_lock scan_lock(scan_mutex_);
+      scans_coalesced_++;
+    }
+    pending_batches_[b].channel = state.channel;
+    std::swap(pending_batches_[b], state.batch);
+  }
 
-      for (leg1 = begin; leg1 != end; ++leg1)
-      {
-        // If this leg has an id or low reliability, skip
-        if ((*leg1)->object_id != ""
-            || (*leg1)->getReliability() < leg_reliability_limit_)
-          continue;
+  // Segment and featurize a scan on the worker of its scanner, and queue the candidates for
+  // tracking. Returns false if the scan yields no candidates to track.
+  bool extractCandidates(ScanSource& source, const sensor_msgs::LaserScan::ConstPtr& scan)
+  {
+    LegDetectorParams params;
+    std::string fixed_frame;
+    vector<tf::Vector3> tracks;
+    if (!snapshot(params, fixed_frame, tracks))
+      return false;
+    double deadline = params.scan_deadline > 0 ? leg_detector::monotonicNow() + params.scan_deadline : 0.0;
+
+    StampedTransform sensor_pose;
+    try
+    {
+      tfl_.lookupTransform(fixed_frame, scan->header.frame_id, scan->header.stamp, sensor_pose);
+    }
+    catch (...)
+    {
+      ROS_WARN("TF exception spot 3.");
+      return false;
+    }
 
-        for (leg2 = begin; leg2 != end; ++leg2)
-        {
-          if (((*leg2)->object_id != "")
-              || ((*leg2)->getReliability() < leg_reliability_limit_)
-              || (leg1 == leg2)) continue;
-          double d = distance(leg1, leg2);
-          if (d < closest_dist)
-          {
-            best1 = leg1;
-            best2 = leg2;
-          }
-        }
-      }
+    if (addToMask(source.state, *scan))
+      return false;
 
-      if (best1 != end)
-      {
-        char id[100];
-        snprintf(id, 100, "Person%d", next_p_id_++);
-        (*best1)->object_id = std::string(id);
-        (*best2)->object_id = std::string(id);
-        (*best1)->other = *best2;
-        (*best2)->other = *best1;
-      }
-      else
-      {
-        break;
-      }
-    }
+    LegDetectorCore::extractCandidates(params, scan, &sensor_pose, tracks, deadline,
+                                       source.state.scan_channel, source.state.batch);
+    queueBatch(source.state);
+    return true;
   }
 
-  void laserCallback(const sensor_msgs::LaserScan::ConstPtr& scan)
+  // Split a cloud into ring scans, segment and featurize the rings at leg height in parallel, and
+  // queue one batch per ring. The tracking pass fuses the legs that several rings see.
+  bool extractCandidates(CloudSource& source, const sensor_msgs::PointCloud2::ConstPtr& cloud)
   {
-    ScanProcessor processor(*scan, mask_);
+    std::string fixed_frame;
+    if (!snapshot(source.params, fixed_frame, source.tracks))
+      return false;
+    source.deadline = source.params.scan_deadline > 0
+                      ? leg_detector::monotonicNow() + source.params.scan_deadline : 0.0;
 
-    processor.splitConnected(connected_thresh_);
-    processor.removeLessThan(5);
+    try
+    {
+      tfl_.lookupTransform(fixed_frame, cloud->header.frame_id, cloud->header.stamp, source.sensor_pose);
+    }
+    catch (...)
+    {
+      ROS_WARN("TF exception spot 3.");
+      return false;
+    }
 
-    CvMat* tmp_mat = cvCreateMat(1, feat_count_, CV_32FC1);
+    std::string error;
+    if (!source.rings.split(*cloud, error))
+    {
+      ROS_WARN_THROTTLE(10.0, "Cannot use the clouds on %s: %s", source.topic.c_str(), error.c_str());
+      return false;
+    }
 
-    // if no measurement matches to a tracker in the last <no_observation_timeout>  seconds: erase tracker
-    ros::Time purge = scan->header.stamp + ros::Duration().fromSec(-no_observation_timeout_s);
-    list<SavedFeature*>::iterator sf_iter = saved_features_.begin();
-    while (sf_iter != saved_features_.end())
+    vector<int> jobs;
+    for (size_t r = 0; r < source.rings.size(); r++)
     {
-      if ((*sf_iter)->meas_time_ < purge)
+      bool wanted;
+      if (source.fixed_rings.empty())
       {
-        if ((*sf_iter)->other)
-          (*sf_iter)->other->other = NULL;
-        delete(*sf_iter);
-        saved_features_.erase(sf_iter++);
+        double height = source.rings.height(r, source.sensor_pose);
+        wanted = height >= source.min_height && height <= source.max_height;
       }
       else
-        ++sf_iter;
+        wanted = find(source.fixed_rings.begin(), source.fixed_rings.end(), (int)r) != source.fixed_rings.end();
+      if (wanted)
+        jobs.push_back(r);
     }
 
-
-    // System update of trackers, and copy updated ones in propagate list
-    list<SavedFeature*> propagated;
-    for (list<SavedFeature*>::iterator sf_iter = saved_features_.begin();
-         sf_iter != saved_features_.end();
-         sf_iter++)
+    while (source.channels.size() < source.rings.size())
     {
-      (*sf_iter)->propagate(scan->header.stamp);
-      propagated.push_back(*sf_iter);
+      int ring = source.channels.size();
+      std::ostringstream name;
+      name << source.topic << " ring " << ring;
+      boost::shared_ptr<ChannelState> state(new ChannelState(source.first_channel + ring, name.str()));
+      std::ostringstream suffix;
+      suffix << ".ring" << ring;
+      loadMask(*state, suffix.str());
+      source.channels.push_back(state);
     }
 
-
-    // Detection step: build up the set of "candidate" clusters
-    // For each candidate, find the closest tracker (within threshold) and add to the match list
-    // If no tracker is found, start a new one
-    multiset<MatchedFeature> matches;
-    for (list<SampleSet*>::iterator i = processor.getClusters().begin();
-         i != processor.getClusters().end();
-         i++)
     {
-      vector<float> f = calcLegFeatures(*i, *scan);
-
-      for (int k = 0; k < feat_count_; k++)
-        tmp_mat->data.fl[k] = (float)(f[k]);
+      boost::mutex::scoped_lock lock(source.job_mutex);
+      source.jobs.swap(jobs);
+      source.next_job = 0;
+      source.jobs_done = 0;
+      source.generation++;
+    }
+    source.job_cond.notify_all();
+    runRingJobs(source);
+    {
+      boost::mutex::scoped_lock lock(source.job_mutex);
+      while (source.jobs_done < source.jobs.size())
+        source.done_cond.wait(lock);
+    }
 
-      float probability = forest.predict_prob(tmp_mat);
-      Stamped<Point> loc((*i)->center(), scan->header.stamp, scan->header.frame_id);
-      try
-      {
-        tfl_.transformPoint(fixed_frame, loc, loc);
-      }
-      catch (...)
+    bool queued = false;
+    for (size_t j = 0; j < source.jobs.size(); j++)
+    {
+      ChannelState& state = *source.channels[source.jobs[j]];
+      if (state.ready)
       {
-        ROS_WARN("TF exception spot 3.");
+        queueBatch(state);
+        queued = true;
       }
+    }
 
-      list<SavedFeature*>::iterator closest = propagated.end();
-      float closest_dist = max_track_jump_m;
+    boost::mutex::scoped_lock lock(scan_mutex_);
+    cloud_rings_used_ = source.jobs.size();
+    return queued;
+  }
 
-      for (list<SavedFeature*>::iterator pf_iter = propagated.begin();
-           pf_iter != propagated.end();
-           pf_iter++)
-      {
-        // find the closest distance between candidate and trackers
-        float dist = loc.distance((*pf_iter)->position_);
-        if (dist < closest_dist)
-        {
-          closest = pf_iter;
-          closest_dist = dist;
-        }
-      }
-      // Nothing close to it, start a new track
-      if (closest == propagated.end())
+  // Segment rings of the current cloud until none are left
+  void runRingJobs(CloudSource& source)
+  {
+    for (;;)
+    {
+      int ring;
       {
-        list<SavedFeature*>::iterator new_saved = saved_features_.insert(saved_features_.end(), new SavedFeature(loc, tfl_));
+        boost::mutex::scoped_lock lock(source.job_mutex);
+        if (source.next_job >= source.jobs.size())
+          return;
+        ring = source.jobs[source.next_job++];
       }
-      // Add the candidate, the tracker and the distance to a match list
-      else
-        matches.insert(MatchedFeature(*i, *closest, closest_dist, probability));
+
+      ChannelState& state = *source.channels[ring];
+      sensor_msgs::LaserScan::ConstPtr scan = source.rings.scan(ring);
+      state.ready = !addToMask(state, *scan);
+      if (state.ready)
+        LegDetectorCore::extractCandidates(source.params, scan, &source.sensor_pose, source.tracks,
+                                           source.deadline, state.scan_channel, state.batch);
+
+      boost::mutex::scoped_lock lock(source.job_mutex);
+      if (++source.jobs_done == source.jobs.size())
+        source.done_cond.notify_all();
     }
+  }
 
-    // loop through _sorted_ matches list
-    // find the match with the shortest distance for each tracker
-    while (matches.size() > 0)
+  void ringLoop(CloudSource* source)
+  {
+    try
     {
-      multiset<MatchedFeature>::iterator matched_iter = matches.begin();
-      bool found = false;
-      list<SavedFeature*>::iterator pf_iter = propagated.begin();
-      while (pf_iter != propagated.end())
+      unsigned long generation = 0;
+      for (;;)
       {
-        // update the tracker with this candidate
-        if (matched_iter->closest_ == *pf_iter)
         {
-          // Transform candidate to fixed frame
-          Stamped<Point> loc(matched_iter->candidate_->center(), scan->header.stamp, scan->header.frame_id);
-          try
-          {
-            tfl_.transformPoint(fixed_frame, loc, loc);
-          }
-          catch (...)
-          {
-            ROS_WARN("TF exception spot 4.");
-          }
-
-          // Update the tracker with the candidate location
-          matched_iter->closest_->update(loc, matched_iter->probability_);
-
-          // remove this match and
-          matches.erase(matched_iter);
-          propagated.erase(pf_iter++);
-          found = true;
-          break;
-        }
-        // still looking for the tracker to update
-        else
-        {
-          pf_iter++;
+          boost::mutex::scoped_lock lock(source->job_mutex);
+          while (source->generation == generation)
+            source->job_cond.wait(lock);
+          generation = source->generation;
         }
+        runRingJobs(*source);
       }
+    }
+    catch (boost::thread_interrupted&)
+    {
+    }
+  }
 
-      // didn't find tracker to update, because it was deleted above
-      // try to assign the candidate to another tracker
-      if (!found)
-      {
-        Stamped<Point> loc(matched_iter->candidate_->center(), scan->header.stamp, scan->header.frame_id);
-        try
-        {
-          tfl_.transformPoint(fixed_frame, loc, loc);
-        }
-        catch (...)
-        {
-          ROS_WARN("TF exception spot 5.");
-        }
-
-        list<SavedFeature*>::iterator closest = propagated.end();
-        float closest_dist = max_track_jump_m;
+  // Track the candidates of all scanners that are waiting, and publish the result. A worker that
+  // finds its batch already taken by the pass of another worker has nothing left to do.
+  void track()
+  {
+    boost::mutex::scoped_lock lock(core_mutex_);
+    {
+      boost::mutex::scoped_lock batch_lock(batch_mutex_);
+      batches_.swap(pending_batches_);
+      pending_batches_.clear();
+    }
+    if (batches_.empty())
+      return;
 
-        for (list<SavedFeature*>::iterator remain_iter = propagated.begin();
-             remain_iter != propagated.end();
-             remain_iter++)
-        {
-          float dist = loc.distance((*remain_iter)->position_);
-          if (dist < closest_dist)
-          {
-            closest = remain_iter;
-            closest_dist = dist;
-          }
-        }
+    core_.processBatches(batches_, result_);
+    batches_.clear();
+    if (core_.getFeatureCount() == 0)
+      return;
+    if (detections_)
+      leg_detector::writeDetections(detections_, result_);
 
-        // no tracker is within a threshold of this candidate
-        // so create a new tracker for this candidate
-        if (closest == propagated.end())
-          list<SavedFeature*>::iterator new_saved = saved_features_.insert(saved_features_.end(), new SavedFeature(loc, tfl_));
-        else
-          matches.insert(MatchedFeature(matched_iter->candidate_, *closest, closest_dist, matched_iter->probability_));
-        matches.erase(matched_iter);
-      }
-    }
+    publish();
+    updater_.update();
+  }
 
-    cvReleaseMat(&tmp_mat);
-    tmp_mat = 0;
-    if (!use_seeds_)
-      pairLegs();
+  void publish()
+  {
+    ros::Time stamp;
+    stamp.fromSec(result_.stamp);
 
     // Publish Data!
-    int i = 0;
+    LEG_PROFILE_START(core_.getProfile(), STAGE_PUBLISH, publish_timer);
+    double publish_start = leg_detector::monotonicNow();
+
+    // Markers are only built when someone is watching, and are the first thing
+    // to go when the scan deadline is near. Their cost estimate halves with every skip, so that
+    // one slow build does not disable them for good.
+    bool markers = (publish_leg_markers_ || publish_people_markers_) && markers_pub_.getNumSubscribers() > 0;
+    if (markers && result_.deadline > 0 && publish_start + publish_time_ > result_.deadline)
+    {
+      markers = false;
+      publish_time_ *= 0.5;
+      result_.degraded |= leg_detector::DEGRADE_MARKERS;
+    }
+
     vector<people_msgs::PositionMeasurement> people;
     vector<people_msgs::PositionMeasurement> legs;
+    visualization_msgs::MarkerArray::Ptr marker_array;
+    if (markers)
+    {
+      marker_array.reset(new visualization_msgs::MarkerArray);
+      marker_array->markers.reserve(result_.legs.size() + result_.people.size());
+    }
 
-    for (list<SavedFeature*>::iterator sf_iter = saved_features_.begin();
-         sf_iter != saved_features_.end();
-         sf_iter++, i++)
+    for (vector<leg_detector::Leg>::const_iterator leg = result_.legs.begin();
+         leg != result_.legs.end();
+         leg++)
     {
       // reliability
-      double reliability = (*sf_iter)->getReliability();
+      double reliability = leg->reliability;
 
-      if ((*sf_iter)->getReliability() > leg_reliability_limit_
+      if (reliability > leg_reliability_limit_
           && publish_legs_)
       {
         people_msgs::PositionMeasurement pos;
-        pos.header.stamp = scan->header.stamp;
-        pos.header.frame_id = fixed_frame;
+        pos.header.stamp = stamp;
+        pos.header.frame_id = fixed_frame_;
         pos.name = "leg_detector";
-        pos.object_id = (*sf_iter)->id_;
-        pos.pos.x = (*sf_iter)->position_[0];
-        pos.pos.y = (*sf_iter)->position_[1];
-        pos.pos.z = (*sf_iter)->position_[2];
+        pos.object_id = leg->id;
+        pos.pos.x = leg->position[0];
+        pos.pos.y = leg->position[1];
+        pos.pos.z = leg->position[2];
         pos.reliability = reliability;
         pos.covariance[0] = pow(0.3 / reliability, 2.0);
         pos.covariance[1] = 0.0;
@@ -884,90 +1006,84 @@ public:
 
       }
 
-      if (publish_leg_markers_)
+      if (publish_leg_markers_ && markers)
       {
         visualization_msgs::Marker m;
-        m.header.stamp = (*sf_iter)->time_;
-        m.header.frame_id = fixed_frame;
+        m.header.stamp.fromSec(leg->stamp);
+        m.header.frame_id = fixed_frame_;
         m.ns = "LEGS";
-        m.id = i;
+        m.id = leg->track_id;
         m.type = m.SPHERE;
-        m.pose.position.x = (*sf_iter)->position_[0];
-        m.pose.position.y = (*sf_iter)->position_[1];
-        m.pose.position.z = (*sf_iter)->position_[2];
+        m.pose.position.x = leg->position[0];
+        m.pose.position.y = leg->position[1];
+        m.pose.position.z = leg->position[2];
 
         m.scale.x = .1;
         m.scale.y = .1;
         m.scale.z = .1;
         m.color.a = 1;
         m.lifetime = ros::Duration(0.5);
-        if ((*sf_iter)->object_id != "")
+        if (leg->object_id != "")
         {
           m.color.r = 1;
         }
         else
         {
-          m.color.b = (*sf_iter)->getReliability();
+          m.color.b = leg->reliability;
         }
 
-        markers_pub_.publish(m);
+        marker_array->markers.push_back(m);
       }
+    }
 
-      if (publish_people_ || publish_people_markers_)
+    for (vector<leg_detector::Person>::const_iterator person = result_.people.begin();
+         person != result_.people.end();
+         person++)
+    {
+      if (publish_people_)
       {
-        SavedFeature* other = (*sf_iter)->other;
-        if (other != NULL && other < (*sf_iter))
-        {
-          double dx = ((*sf_iter)->position_[0] + other->position_[0]) / 2,
-                 dy = ((*sf_iter)->position_[1] + other->position_[1]) / 2,
-                 dz = ((*sf_iter)->position_[2] + other->position_[2]) / 2;
-
-          if (publish_people_)
-          {
-            reliability = reliability * other->reliability;
-            people_msgs::PositionMeasurement pos;
-            pos.header.stamp = (*sf_iter)->time_;
-            pos.header.frame_id = fixed_frame;
-            pos.name = (*sf_iter)->object_id;;
-            pos.object_id = (*sf_iter)->id_ + "|" + other->id_;
-            pos.pos.x = dx;
-            pos.pos.y = dy;
-            pos.pos.z = dz;
-            pos.reliability = reliability;
-            pos.covariance[0] = pow(0.3 / reliability, 2.0);
-            pos.covariance[1] = 0.0;
-            pos.covariance[2] = 0.0;
-            pos.covariance[3] = 0.0;
-            pos.covariance[4] = pow(0.3 / reliability, 2.0);
-            pos.covariance[5] = 0.0;
-            pos.covariance[6] = 0.0;
-            pos.covariance[7] = 0.0;
-            pos.covariance[8] = 10000.0;
-            pos.initialization = 0;
-            people.push_back(pos);
-          }
-
-          if (publish_people_markers_)
-          {
-            visualization_msgs::Marker m;
-            m.header.stamp = (*sf_iter)->time_;
-            m.header.frame_id = fixed_frame;
-            m.ns = "PEOPLE";
-            m.id = i;
-            m.type = m.SPHERE;
-            m.pose.position.x = dx;
-            m.pose.position.y = dy;
-            m.pose.position.z = dz;
-            m.scale.x = .2;
-            m.scale.y = .2;
-            m.scale.z = .2;
-            m.color.a = 1;
-            m.color.g = 1;
-            m.lifetime = ros::Duration(0.5);
-
-            markers_pub_.publish(m);
-          }
-        }
+        double reliability = person->reliability;
+        people_msgs::PositionMeasurement pos;
+        pos.header.stamp.fromSec(person->stamp);
+        pos.header.frame_id = fixed_frame_;
+        pos.name = person->name;
+        pos.object_id = person->object_id;
+        pos.pos.x = person->position[0];
+        pos.pos.y = person->position[1];
+        pos.pos.z = person->position[2];
+        pos.reliability = reliability;
+        pos.covariance[0] = pow(0.3 / reliability, 2.0);
+        pos.covariance[1] = 0.0;
+        pos.covariance[2] = 0.0;
+        pos.covariance[3] = 0.0;
+        pos.covariance[4] = pow(0.3 / reliability, 2.0);
+        pos.covariance[5] = 0.0;
+        pos.covariance[6] = 0.0;
+        pos.covariance[7] = 0.0;
+        pos.covariance[8] = 10000.0;
+        pos.initialization = 0;
+        people.push_back(pos);
+      }
+
+      if (publish_people_markers_ && markers)
+      {
+        visualization_msgs::Marker m;
+        m.header.stamp.fromSec(person->stamp);
+        m.header.frame_id = fixed_frame_;
+        m.ns = "PEOPLE";
+        m.id = person->track_id;
+        m.type = m.SPHERE;
+        m.pose.position.x = person->position[0];
+        m.pose.position.y = person->position[1];
+        m.pose.position.z = person->position[2];
+        m.scale.x = .2;
+        m.scale.y = .2;
+        m.scale.z = .2;
+        m.color.a = 1;
+        m.color.g = 1;
+        m.lifetime = ros::Duration(0.5);
+
+        marker_array->markers.push_back(m);
       }
     }
 
@@ -983,18 +1099,72 @@ public:
       array.people = people;
       people_measurements_pub_.publish(array);
     }
+
+    // People with the velocity of their leg filters, as people_velocity_tracker would estimate it
+    if (publish_people_velocity_ && people_pub_.getNumSubscribers() > 0)
+    {
+      people_msgs::People::Ptr people_msg(new people_msgs::People);
+      people_msg->header.stamp = stamp;
+      people_msg->header.frame_id = fixed_frame_;
+      people_msg->people.resize(result_.people.size());
+      for (size_t j = 0; j < result_.people.size(); j++)
+      {
+        const leg_detector::Person& person = result_.people[j];
+        people_msgs::Person& p = people_msg->people[j];
+        p.name = person.object_id;
+        p.position.x = person.position[0];
+        p.position.y = person.position[1];
+        p.position.z = person.position[2];
+        p.velocity.x = person.velocity[0];
+        p.velocity.y = person.velocity[1];
+        p.velocity.z = person.velocity[2];
+        p.reliability = person.reliability;
+      }
+      people_pub_.publish(people_msg);
+    }
+
+    if (markers)
+    {
+      markers_pub_.publish(marker_array);
+      publish_time_ = leg_detector::monotonicNow() - publish_start;
+    }
+    LEG_PROFILE_STOP(publish_timer);
+    core_.commitProfile();
+
+    if (result_.degraded)
+    {
+      ROS_DEBUG("Scan at %.3f degraded to meet its deadline:%s%s%s", result_.stamp,
+                result_.degraded & leg_detector::DEGRADE_FAR_CLUSTERS ? " far clusters" : "",
+                result_.degraded & leg_detector::DEGRADE_PAIRING ? " pairing" : "",
+                result_.degraded & leg_detector::DEGRADE_MARKERS ? " markers" : "");
+
+      boost::mutex::scoped_lock lock(scan_mutex_);
+      scans_degraded_++;
+      skipped_clusters_ += result_.skipped_clusters;
+      for (int step = 0; step < 3; step++)
+        if (result_.degraded & (1 << step))
+          degrade_steps_[step]++;
+    }
   }
 };
 
-int main(int argc, char **argv)
+// Runs LegDetector inside a nodelet manager, so scans from a driver or laser filter
+// nodelet in the same manager are handed over without serialization.
+class LegDetectorNodelet : public nodelet::Nodelet
 {
-  ros::init(argc, argv, "leg_detector");
-  g_argc = argc;
-  g_argv = argv;
-  ros::NodeHandle nh;
-  LegDetector ld(nh);
-  ros::spin();
+  boost::shared_ptr<LegDetector> detector_;
 
-  return 0;
-}
+  virtual void onInit()
+  {
+    // The classifier comes from the private model_file parameter, or from the first
+    // argument as with the standalone executable.
+    std::string model_file;
+    getPrivateNodeHandle().param<std::string>("model_file", model_file, "");
+    if (model_file.empty() && !getMyArgv().empty())
+      model_file = getMyArgv()[0];
+
+    detector_.reset(new LegDetector(getNodeHandle(), getPrivateNodeHandle(), model_file));
+  }
+};
 
+PLUGINLIB_EXPORT_CLASS(LegDetectorNodelet, nodelet::Nodelet)
@@ -0,0 +1,1237 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <leg_detector/leg_detector_core.h>
+#include <leg_detector/calc_leg_features.h>
+
+#include <opencv/cxcore.h>
+#include <opencv/cv.h>
+#include <opencv/ml.h>
+
+#include <people_tracking_filter/tracker_kalman.h>
+#include <people_tracking_filter/state_pos_vel.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <set>
+
+using namespace std;
+using namespace laser_processor;
+using namespace estimation;
+using namespace BFL;
+using namespace MatrixWrapper;
+using tf::Vector3;
+
+namespace leg_detector
+{
+class SavedFeature
+{
+public:
+  static int nextid;
+  const LegDetectorParams& params_;
+
+  BFL::StatePosVel sys_sigma_;
+  TrackerKalman filter_;
+
+  int int_id_;
+  string id_;
+  string object_id;
+  double time_;
+  double meas_time_;
+
+  double reliability, p;
+
+  Vector3 position_;
+  Vector3 velocity_;
+  SavedFeature* other;
+  float dist_to_person_;
+
+  // The last full classification, and the number of updates that reused it since
+  vector<float> classified_features_;
+  double classified_probability_;
+  int reuse_count_;
+
+  // one leg tracker
+  SavedFeature(const Vector3& loc, double time, const LegDetectorParams& params)
+    : params_(params),
+      sys_sigma_(Vector3(0.05, 0.05, 0.05), Vector3(1.0, 1.0, 1.0)),
+      filter_("tracker_name", sys_sigma_),
+      reliability(-1.), p(4),
+      classified_probability_(0.0), reuse_count_(0)
+  {
+    int_id_ = nextid++;
+    char id[100];
+    snprintf(id, 100, "legtrack%d", int_id_);
+    id_ = std::string(id);
+
+    object_id = "";
+    time_ = time;
+    meas_time_ = time;
+    other = NULL;
+
+    StatePosVel prior_sigma(Vector3(0.1, 0.1, 0.1), Vector3(0.0000001, 0.0000001, 0.0000001));
+    filter_.initialize(loc, prior_sigma, time_);
+
+    updatePosition();
+  }
+
+  void propagate(double time)
+  {
+    time_ = time;
+
+    filter_.updatePrediction(time);
+
+    updatePosition();
+  }
+
+  //! features is the vector the probability was classified from, or NULL if it was reused.
+  void update(const Vector3& loc, double time, double probability, const vector<float>* features)
+  {
+    if (features == NULL)
+      reuse_count_++;
+    else
+    {
+      classified_features_ = *features;
+      classified_probability_ = probability;
+      reuse_count_ = 0;
+    }
+
+    meas_time_ = time;
+    time_ = meas_time_;
+
+    SymmetricMatrix cov(3);
+    cov = 0.0;
+    cov(1, 1) = 0.0025;
+    cov(2, 2) = 0.0025;
+    cov(3, 3) = 0.0025;
+
+    filter_.updateCorrection(loc, cov);
+
+    updatePosition();
+
+    if (reliability < 0 || !params_.use_filter)
+    {
+      reliability = probability;
+      p = params_.kal_p;
+    }
+    else
+    {
+      p += params_.kal_q;
+      double k = p / (p + params_.kal_r);
+      reliability += k * (probability - reliability);
+      p *= (1 - k);
+    }
+  }
+
+  //! Whether a candidate with these features may skip the classifier and reuse classified_probability_.
+  bool canReuseProbability(const vector<float>& features) const
+  {
+    if (reuse_count_ >= params_.reuse_max_scans
+        || reliability < params_.reuse_min_reliability
+        || classified_features_.size() != features.size())
+      return false;
+
+    double drift = 0.0, norm = 0.0;
+    for (size_t k = 0; k < features.size(); k++)
+    {
+      drift += (features[k] - classified_features_[k]) * (features[k] - classified_features_[k]);
+      norm += classified_features_[k] * classified_features_[k];
+    }
+    return drift <= params_.reuse_feature_drift * params_.reuse_feature_drift * norm;
+  }
+
+  double getLifetime()
+  {
+    return filter_.getLifetime();
+  }
+
+  double getReliability()
+  {
+    return reliability;
+  }
+
+private:
+  void updatePosition()
+  {
+    StatePosVel est;
+    filter_.getEstimate(est);
+
+    position_ = est.pos_;
+    velocity_ = est.vel_;
+  }
+};
+
+int SavedFeature::nextid = 0;
+
+
+
+// A cluster of the current scan, ordered by its range from the sensor
+struct Candidate
+{
+  SampleSet* cluster_;
+  Vector3 center_;
+  float range_;
+
+  Candidate(SampleSet* cluster) : cluster_(cluster), center_(cluster->center()), range_(center_.length()) {}
+
+  inline bool operator< (const Candidate& b) const
+  {
+    return range_ < b.range_;
+  }
+};
+
+// Orders fused candidates by their range from the sensor that saw them
+static bool nearerCandidate(const LegCandidate* a, const LegCandidate* b)
+{
+  return a->range < b->range;
+}
+
+// A candidate that matched no track, and may start one
+struct Birth
+{
+  Vector3 loc_;
+  double probability_;
+
+  Birth(const Vector3& loc, double probability) : loc_(loc), probability_(probability) {}
+
+  inline bool operator< (const Birth& b) const
+  {
+    return probability_ > b.probability_;
+  }
+};
+
+
+
+class MatchedFeature
+{
+public:
+  SavedFeature* closest_;
+  float distance_;
+  double probability_;
+  Vector3 loc_;
+  const vector<float>* features_;  // the features of the candidate
+  bool reused_;                    // whether probability_ was reused from closest_
+
+  MatchedFeature(SavedFeature* closest, float distance, double probability, const Vector3& loc,
+                 const vector<float>* features, bool reused)
+    : closest_(closest)
+    , distance_(distance)
+    , probability_(probability)
+    , loc_(loc)
+    , features_(features)
+    , reused_(reused)
+  {}
+
+  inline bool operator< (const MatchedFeature& b) const
+  {
+    return (distance_ <  b.distance_);
+  }
+};
+
+
+
+// Adds the beams within max_track_jump of the point at the given bearing and range.
+static void addSector(const LegDetectorParams& params, const sensor_msgs::LaserScan& scan,
+                      float angle, float range, ScanChannel& channel)
+{
+  const int n = scan.ranges.size();
+  int first = 0, last = n - 1;
+
+  if (range > params.max_track_jump)
+  {
+    float margin = atan2(params.max_track_jump, range);
+    float a = (angle - margin - scan.angle_min) / scan.angle_increment;
+    float b = (angle + margin - scan.angle_min) / scan.angle_increment;
+    first = std::max(first, (int)floor(std::min(a, b)));
+    last = std::min(last, (int)ceil(std::max(a, b)));
+  }
+  if (first > last)
+    return;
+
+  channel.roi_edges[first]++;
+  channel.roi_edges[last + 1]--;
+}
+
+// Marks the beams of the region of interest in channel.roi, returns false when the whole scan is to be processed.
+static bool selectBeams(const LegDetectorParams& params, const sensor_msgs::LaserScan& scan,
+                        const tf::Transform* sensor_pose, const vector<Vector3>& tracks, ScanChannel& channel)
+{
+  const size_t n = scan.ranges.size();
+
+  // Without a region of interest no scan is compared against the previous one. Dropping it makes
+  // the first scan after the region of interest is enabled again a full one.
+  if (params.roi_full_scan_interval <= 1)
+  {
+    channel.scans_since_full = 0;
+    channel.prev_ranges.clear();
+    return false;
+  }
+
+  bool full = ++channel.scans_since_full >= params.roi_full_scan_interval
+              || channel.prev_ranges.size() != n;
+
+  if (full)
+  {
+    channel.scans_since_full = 0;
+    channel.prev_ranges = scan.ranges;
+    return false;
+  }
+
+  // Sectors are accumulated as +1/-1 edges and resolved in a single pass
+  channel.roi_edges.assign(n + 1, 0);
+
+  tf::Transform to_sensor = sensor_pose ? sensor_pose->inverse() : tf::Transform::getIdentity();
+  for (vector<Vector3>::const_iterator t = tracks.begin(); t != tracks.end(); t++)
+  {
+    Vector3 p = to_sensor(*t);
+    addSector(params, scan, atan2(p.y(), p.x()), hypot(p.x(), p.y()), channel);
+  }
+
+  for (size_t i = 0; i < n; i++)
+  {
+    float r = scan.ranges[i], prev = channel.prev_ranges[i];
+    bool valid = r > scan.range_min && r < scan.range_max;
+    bool prev_valid = prev > scan.range_min && prev < scan.range_max;
+
+    if (valid && prev_valid)
+    {
+      if (fabs(r - prev) > params.roi_change_threshold)
+        addSector(params, scan, scan.angle_min + i * scan.angle_increment, std::min(r, prev), channel);
+    }
+    else if (valid || prev_valid)
+      addSector(params, scan, scan.angle_min + i * scan.angle_increment, valid ? r : prev, channel);
+  }
+  channel.prev_ranges = scan.ranges;
+
+  channel.roi.resize(n);
+  int depth = 0;
+  for (size_t i = 0; i < n; i++)
+  {
+    depth += channel.roi_edges[i];
+    channel.roi[i] = depth > 0;
+  }
+  return true;
+}
+
+
+
+LegDetectorCore::LegDetectorCore()
+  : forest_(NULL),
+    feat_mat_(NULL),
+    feat_count_(0),
+    pending_forest_(NULL),
+    retired_forest_(NULL),
+    model_swaps_(0),
+    next_p_id_(0),
+    peak_tracks_(0),
+    pair_time_(0.0),
+    evicted_tracks_(0),
+    rejected_births_(0),
+    batch_stamp_(0.0),
+    late_batches_(0)
+{
+}
+
+LegDetectorCore::~LegDetectorCore()
+{
+  for (list<SavedFeature*>::iterator it = saved_features_.begin(); it != saved_features_.end(); it++)
+    delete *it;
+  if (feat_mat_)
+    cvReleaseMat(&feat_mat_);
+  delete forest_;
+  delete pending_forest_.exchange(NULL);
+  delete retired_forest_.exchange(NULL);
+}
+
+bool LegDetectorCore::loadModel(const std::string& file, std::string* error)
+{
+  std::string reason;
+  CvRTrees* forest = readModel(file, reason);
+  if (forest == NULL)
+  {
+    if (error)
+      *error = reason;
+    return false;
+  }
+
+  useModel(forest);
+  return true;
+}
+
+CvRTrees* LegDetectorCore::readModel(const std::string& file, std::string& error)
+{
+  CvRTrees* forest = new CvRTrees;
+  try
+  {
+    forest->load(file.c_str());
+  }
+  catch (cv::Exception& e)
+  {
+    error = e.what();
+    delete forest;
+    return NULL;
+  }
+
+  const CvMat* active = forest->get_active_var_mask();
+  if (active == NULL)
+  {
+    error = "no random forest found in " + file;
+    delete forest;
+    return NULL;
+  }
+  if (active->cols != LEG_FEATURE_COUNT)
+  {
+    std::ostringstream msg;
+    msg << "the forest in " << file << " uses " << active->cols << " features, calcLegFeatures computes "
+        << LEG_FEATURE_COUNT;
+    error = msg.str();
+    delete forest;
+    return NULL;
+  }
+  return forest;
+}
+
+void LegDetectorCore::offerModel(CvRTrees* forest)
+{
+  delete retired_forest_.exchange(NULL);
+  delete pending_forest_.exchange(forest);
+}
+
+void LegDetectorCore::useModel(CvRTrees* forest)
+{
+  delete forest_;
+  forest_ = forest;
+  feat_count_ = LEG_FEATURE_COUNT;
+  if (feat_mat_ == NULL)
+    feat_mat_ = cvCreateMat(1, feat_count_, CV_32FC1);
+}
+
+void LegDetectorCore::processScan(const std::vector<float>& ranges, const ScanGeometry& geometry,
+                                  const tf::Transform* sensor_pose, double stamp, LegDetectorResult& result)
+{
+  sensor_msgs::LaserScan::Ptr scan(new sensor_msgs::LaserScan);
+  scan->header.stamp.fromSec(stamp);
+  scan->angle_min = geometry.angle_min;
+  scan->angle_max = geometry.angle_max;
+  scan->angle_increment = geometry.angle_increment;
+  scan->range_min = geometry.range_min;
+  scan->range_max = geometry.range_max;
+  scan->ranges = ranges;
+
+  processScan(scan, sensor_pose, result);
+}
+
+void LegDetectorCore::processScan(const sensor_msgs::LaserScan::ConstPtr& scan,
+                                  const tf::Transform* sensor_pose, LegDetectorResult& result)
+{
+  processScan(scan, sensor_pose, 0, channel_, result);
+}
+
+void LegDetectorCore::processScan(const sensor_msgs::LaserScan::ConstPtr& scan, const tf::Transform* sensor_pose,
+                                  int channel_index, ScanChannel& channel, LegDetectorResult& result)
+{
+  if (feat_count_ == 0)
+    return;
+  const double deadline = params_.scan_deadline > 0 ? monotonicNow() + params_.scan_deadline : 0.0;
+
+  // The region of interest follows the tracks as the last pass left them, as in the node, whose
+  // scanners extract their candidates while another pass may be running
+  getTrackPositions(scan_tracks_);
+  scan_batch_.resize(1);
+  scan_batch_[0].channel = channel_index;
+  extractCandidates(params_, scan, sensor_pose, scan_tracks_, deadline, channel, scan_batch_[0]);
+  processBatches(scan_batch_, result);
+}
+
+void LegDetectorCore::processBatches(const std::vector<CandidateBatch>& batches, LegDetectorResult& result)
+{
+  // Older batches of a channel are superseded by its newest one
+  vector<const CandidateBatch*> newest;
+  double stamp = 0.0, deadline = 0.0;
+  for (size_t b = 0; b < batches.size(); b++)
+  {
+    bool superseded = false;
+    for (size_t later = b + 1; later < batches.size() && !superseded; later++)
+      superseded = batches[later].channel == batches[b].channel;
+    if (superseded)
+      continue;
+
+    newest.push_back(&batches[b]);
+    stamp = std::max(stamp, batches[b].stamp);
+    if (batches[b].deadline > 0 && (deadline == 0 || batches[b].deadline < deadline))
+      deadline = batches[b].deadline;
+  }
+  if (newest.empty())
+    return;
+
+  // Scanners are not in sync, and a batch of a lagging one can be older than the last pass. Rather
+  // than rolling the tracks back, its measurements are applied at the time of the last pass. A
+  // jump back by more than the observation timeout is a restart of time, e.g. a looping bag.
+  if (stamp >= batch_stamp_ - params_.no_observation_timeout)
+  {
+    for (size_t b = 0; b < newest.size(); b++)
+      if (newest[b]->stamp < batch_stamp_)
+        late_batches_++;
+    stamp = std::max(stamp, batch_stamp_);
+  }
+  batch_stamp_ = stamp;
+  if (!prepare(stamp, deadline, result))
+    return;
+
+  // A leg in view of several scanners is measured once, by the cluster with the most points
+  fused_.clear();
+  for (size_t b = 0; b < newest.size(); b++)
+  {
+    const CandidateBatch& batch = *newest[b];
+    LEG_PROFILE_MERGE(profile_, batch.profile);
+    result.degraded |= batch.degraded;
+    result.skipped_clusters += batch.skipped_clusters;
+
+    const size_t others = fused_.size();
+    for (size_t c = 0; c < batch.candidates.size(); c++)
+    {
+      const LegCandidate* candidate = &batch.candidates[c];
+      size_t same = others;
+      for (size_t f = 0; f < others && same == others; f++)
+        if (candidate->position.distance(fused_[f]->position) < params_.fusion_distance)
+          same = f;
+
+      if (same == others)
+        fused_.push_back(candidate);
+      else if (candidate->points > fused_[same]->points)
+        fused_[same] = candidate;
+    }
+  }
+
+  // Under a deadline the nearest clusters go first, as within a single scan
+  if (deadline > 0)
+    stable_sort(fused_.begin(), fused_.end(), nearerCandidate);
+
+  update(fused_, stamp, result);
+}
+
+// Starts a scan: swaps in a newly offered model, and purges and predicts the tracks up to stamp.
+// Returns false if there is no classifier to detect with.
+bool LegDetectorCore::prepare(double stamp, double deadline, LegDetectorResult& result)
+{
+  // Switch to a newly offered model between scans, leaving the old one for the loader to free
+  if (pending_forest_.load(boost::memory_order_relaxed) != NULL)
+  {
+    CvRTrees* forest = pending_forest_.exchange(NULL, boost::memory_order_acquire);
+    if (forest != NULL)
+    {
+      delete retired_forest_.exchange(forest_);
+      forest_ = NULL;
+      useModel(forest);
+      model_swaps_++;
+    }
+  }
+
+  // Without a classifier there is nothing to detect with.
+  if (feat_count_ == 0)
+    return false;
+
+  result.stamp = stamp;
+  result.deadline = deadline;
+  result.degraded = 0;
+  result.skipped_clusters = 0;
+
+  LEG_PROFILE_BEGIN(profile_);
+  LEG_PROFILE_STAGE(profile_, STAGE_PREDICT);
+
+  // if no measurement matches to a tracker in the last <no_observation_timeout>  seconds: erase tracker
+  double purge = stamp - params_.no_observation_timeout;
+  list<SavedFeature*>::iterator sf_iter = saved_features_.begin();
+  while (sf_iter != saved_features_.end())
+  {
+    if ((*sf_iter)->meas_time_ < purge)
+    {
+      if ((*sf_iter)->other)
+        (*sf_iter)->other->other = NULL;
+      delete(*sf_iter);
+      saved_features_.erase(sf_iter++);
+    }
+    else
+      ++sf_iter;
+  }
+
+  // System update of trackers
+  for (list<SavedFeature*>::iterator sf_iter = saved_features_.begin();
+       sf_iter != saved_features_.end();
+       sf_iter++)
+    (*sf_iter)->propagate(stamp);
+
+  return true;
+}
+
+void LegDetectorCore::extractCandidates(const LegDetectorParams& params, const sensor_msgs::LaserScan::ConstPtr& scan,
+                                        const tf::Transform* sensor_pose, const std::vector<tf::Vector3>& tracks,
+                                        double deadline, ScanChannel& channel, CandidateBatch& batch)
+{
+  batch.stamp = scan->header.stamp.toSec();
+  batch.deadline = deadline;
+  batch.candidates.clear();
+  batch.degraded = 0;
+  batch.skipped_clusters = 0;
+  LEG_PROFILE_BEGIN(batch.profile);
+
+  // Segmentation, restricted to the region of interest around the tracks if enabled
+  LEG_PROFILE_START(batch.profile, STAGE_SEGMENT, segment_timer);
+
+  const vector<bool>* beams = selectBeams(params, *scan, sensor_pose, tracks, channel) ? &channel.roi : NULL;
+  ScanProcessor processor(scan, channel.mask, 0.03, beams);
+
+  processor.splitConnected(params.connected_thresh);
+  processor.removeLessThan(5);
+  LEG_PROFILE_COUNT(batch.profile, allocations, processor.getAllocations());
+
+  LEG_PROFILE_STOP(segment_timer);
+  LEG_PROFILE_COUNT(batch.profile, beams, beams ? count(channel.roi.begin(), channel.roi.end(), true) : scan->ranges.size());
+  LEG_PROFILE_COUNT(batch.profile, clusters, processor.getClusters().size());
+
+  vector<Candidate> clusters;
+  clusters.reserve(processor.getClusters().size());
+  for (list<SampleSet*>::iterator i = processor.getClusters().begin();
+       i != processor.getClusters().end();
+       i++)
+    clusters.push_back(Candidate(*i));
+
+  // Under a deadline the nearest clusters go first, so that the far ones are skipped when time runs out
+  if (deadline > 0)
+    stable_sort(clusters.begin(), clusters.end());
+  const double clusters_start = monotonicNow();
+
+  batch.candidates.reserve(clusters.size());
+  for (size_t c = 0; c < clusters.size(); c++)
+  {
+    if (deadline > 0 && c > 0)
+    {
+      double now = monotonicNow();
+      if (now + (now - clusters_start) / c > deadline)
+      {
+        batch.degraded |= DEGRADE_FAR_CLUSTERS;
+        batch.skipped_clusters = clusters.size() - c;
+        break;
+      }
+    }
+
+    LEG_PROFILE_STAGE(batch.profile, STAGE_FEATURIZE);
+    batch.candidates.push_back(LegCandidate());
+    LegCandidate& candidate = batch.candidates.back();
+    candidate.features = calcLegFeatures(clusters[c].cluster_, *scan);
+    candidate.position = sensor_pose ? (*sensor_pose)(clusters[c].center_) : clusters[c].center_;
+    candidate.range = clusters[c].range_;
+    candidate.points = clusters[c].cluster_->size();
+  }
+}
+
+void LegDetectorCore::getTrackPositions(std::vector<tf::Vector3>& positions) const
+{
+  positions.clear();
+  for (list<SavedFeature*>::const_iterator sf_iter = saved_features_.begin();
+       sf_iter != saved_features_.end();
+       sf_iter++)
+    positions.push_back((*sf_iter)->position_);
+}
+
+// Associates the candidates with the predicted tracks, starts new tracks and pairs legs.
+void LegDetectorCore::update(std::vector<const LegCandidate*>& candidates, double stamp, LegDetectorResult& result)
+{
+  const double deadline = result.deadline;
+
+  // copy the predicted trackers in the propagated list
+  list<SavedFeature*> propagated(saved_features_.begin(), saved_features_.end());
+
+  // For each candidate, find the closest tracker (within threshold) and add to the match list
+  // If no tracker is found, start a new one
+  multiset<MatchedFeature> matches;
+  vector<Birth> births;
+
+  const double candidates_start = monotonicNow();
+  for (size_t c = 0; c < candidates.size(); c++)
+  {
+    if (deadline > 0 && c > 0)
+    {
+      double now = monotonicNow();
+      if (now + (now - candidates_start) / c > deadline)
+      {
+        result.degraded |= DEGRADE_FAR_CLUSTERS;
+        result.skipped_clusters += candidates.size() - c;
+        break;
+      }
+    }
+
+    const LegCandidate& candidate = *candidates[c];
+    const vector<float>& f = candidate.features;
+
+    LEG_PROFILE_START(profile_, STAGE_ASSOCIATE, candidate_timer);
+    const Vector3& loc = candidate.position;
+
+    list<SavedFeature*>::iterator closest = propagated.end();
+    float closest_dist = params_.max_track_jump;
+
+    for (list<SavedFeature*>::iterator pf_iter = propagated.begin();
+         pf_iter != propagated.end();
+         pf_iter++)
+    {
+      // find the closest distance between candidate and trackers
+      float dist = loc.distance((*pf_iter)->position_);
+      if (dist < closest_dist)
+      {
+        closest = pf_iter;
+        closest_dist = dist;
+      }
+    }
+    LEG_PROFILE_STOP(candidate_timer);
+
+    // Nothing close to it, start a new track. Its probability is only needed to gate or rank births.
+    if (closest == propagated.end())
+    {
+      bool gated = params_.birth_probability > 0 || params_.max_tracks > 0;
+      births.push_back(Birth(loc, gated ? classify(f) : -1.0));
+      continue;
+    }
+
+    // A stable, reliable track whose shape barely changed keeps the probability of its last classification
+    bool classified = !(*closest)->canReuseProbability(f);
+    double probability;
+    if (classified)
+      probability = classify(f);
+    else
+    {
+      probability = (*closest)->classified_probability_;
+      LEG_PROFILE_COUNT(profile_, reused, 1);
+    }
+
+    // Add the candidate, the tracker and the distance to a match list
+    LEG_PROFILE_STAGE(profile_, STAGE_ASSOCIATE);
+    matches.insert(MatchedFeature(*closest, closest_dist, probability, loc, &f, !classified));
+  }
+
+  // loop through _sorted_ matches list
+  // find the match with the shortest distance for each tracker
+  LEG_PROFILE_START(profile_, STAGE_ASSOCIATE, associate_timer);
+  while (matches.size() > 0)
+  {
+    multiset<MatchedFeature>::iterator matched_iter = matches.begin();
+    bool found = false;
+    list<SavedFeature*>::iterator pf_iter = propagated.begin();
+    while (pf_iter != propagated.end())
+    {
+      // update the tracker with this candidate
+      if (matched_iter->closest_ == *pf_iter)
+      {
+        // Update the tracker with the candidate location
+        matched_iter->closest_->update(matched_iter->loc_, stamp, matched_iter->probability_,
+                                       matched_iter->reused_ ? NULL : matched_iter->features_);
+
+        // remove this match and
+        matches.erase(matched_iter);
+        propagated.erase(pf_iter++);
+        found = true;
+        break;
+      }
+      // still looking for the tracker to update
+      else
+      {
+        pf_iter++;
+      }
+    }
+
+    // didn't find tracker to update, because it was deleted above
+    // try to assign the candidate to another tracker
+    if (!found)
+    {
+      const Vector3& loc = matched_iter->loc_;
+
+      list<SavedFeature*>::iterator closest = propagated.end();
+      float closest_dist = params_.max_track_jump;
+
+      for (list<SavedFeature*>::iterator remain_iter = propagated.begin();
+           remain_iter != propagated.end();
+           remain_iter++)
+      {
+        float dist = loc.distance((*remain_iter)->position_);
+        if (dist < closest_dist)
+        {
+          closest = remain_iter;
+          closest_dist = dist;
+        }
+      }
+
+      // A probability reused from the original tracker says nothing about the new one, or a birth.
+      // The classification counts as STAGE_CLASSIFY alone.
+      MatchedFeature match(*matched_iter);
+      if (match.reused_)
+      {
+        LEG_PROFILE_STOP(associate_timer);
+        match.probability_ = classify(*match.features_);
+        match.reused_ = false;
+        LEG_PROFILE_RESTART(associate_timer);
+      }
+
+      // no tracker is within a threshold of this candidate
+      // so create a new tracker for this candidate
+      if (closest == propagated.end())
+        births.push_back(Birth(loc, match.probability_));
+      else
+      {
+        match.closest_ = *closest;
+        match.distance_ = closest_dist;
+        matches.insert(match);
+      }
+      matches.erase(matched_iter);
+    }
+  }
+
+  // Start the new tracks, the most probable legs first, within the track budget. The tracks born
+  // here are appended after the existing ones, and are not evicted for the less probable births.
+  stable_sort(births.begin(), births.end());
+  size_t existing = saved_features_.size();
+  for (vector<Birth>::const_iterator b = births.begin(); b != births.end(); b++)
+  {
+    if (params_.birth_probability > 0 && b->probability_ < params_.birth_probability)
+    {
+      rejected_births_++;
+      continue;
+    }
+    if (params_.max_tracks > 0 && (int)saved_features_.size() >= params_.max_tracks)
+    {
+      if (!evictTrack(b->probability_, existing))
+      {
+        rejected_births_++;
+        continue;
+      }
+      existing--;
+    }
+    saved_features_.push_back(new SavedFeature(b->loc_, stamp, params_));
+  }
+  peak_tracks_ = std::max(peak_tracks_, saved_features_.size());
+  LEG_PROFILE_STOP(associate_timer);
+
+  if (!params_.use_seeds)
+  {
+    LEG_PROFILE_STAGE(profile_, STAGE_PAIR);
+    double pair_start = monotonicNow();
+    // The estimate halves with every skip, so that one slow pass does not disable pairing for good
+    if (deadline > 0 && pair_start + pair_time_ > deadline)
+    {
+      pair_time_ *= 0.5;
+      result.degraded |= DEGRADE_PAIRING;
+    }
+    else
+    {
+      pairLegs();
+      pair_time_ = monotonicNow() - pair_start;
+    }
+  }
+  LEG_PROFILE_COUNT(profile_, tracks, saved_features_.size());
+
+  LEG_PROFILE_STAGE(profile_, STAGE_PUBLISH);
+  fillResult(result);
+}
+
+double LegDetectorCore::classify(const vector<float>& features)
+{
+  LEG_PROFILE_STAGE(profile_, STAGE_CLASSIFY);
+  for (int k = 0; k < feat_count_; k++)
+    feat_mat_->data.fl[k] = (float)(features[k]);
+
+  return forest_->predict_prob(feat_mat_);
+}
+
+// Makes room for a new track of the given priority by deleting the track with the lowest reliability,
+// the shortest lived among equals, if that is lower. Only the first existing tracks are candidates,
+// not the ones born after them in the same pass. Returns false if no track was deleted.
+bool LegDetectorCore::evictTrack(double priority, size_t existing)
+{
+  list<SavedFeature*>::iterator victim = saved_features_.end();
+  list<SavedFeature*>::iterator sf_iter = saved_features_.begin();
+  for (size_t i = 0; i < existing && sf_iter != saved_features_.end(); i++, sf_iter++)
+  {
+    if (victim == saved_features_.end()
+        || (*sf_iter)->reliability < (*victim)->reliability
+        || ((*sf_iter)->reliability == (*victim)->reliability
+            && (*sf_iter)->getLifetime() < (*victim)->getLifetime()))
+      victim = sf_iter;
+  }
+
+  if (victim == saved_features_.end() || (*victim)->reliability >= priority)
+    return false;
+
+  if ((*victim)->other)
+    (*victim)->other->other = NULL;
+  delete(*victim);
+  saved_features_.erase(victim);
+  evicted_tracks_++;
+  return true;
+}
+
+void LegDetectorCore::fillResult(LegDetectorResult& result) const
+{
+  result.legs.clear();
+  result.people.clear();
+
+  for (list<SavedFeature*>::const_iterator sf_iter = saved_features_.begin();
+       sf_iter != saved_features_.end();
+       sf_iter++)
+  {
+    const SavedFeature* sf = *sf_iter;
+
+    Leg leg;
+    leg.track_id    = sf->int_id_;
+    leg.id          = sf->id_;
+    leg.object_id   = sf->object_id;
+    leg.position    = sf->position_;
+    leg.velocity    = sf->velocity_;
+    leg.reliability = sf->reliability;
+    leg.stamp       = sf->time_;
+    result.legs.push_back(leg);
+
+    // Each pair is reported once, by the older leg, so that the output is reproducible
+    SavedFeature* other = sf->other;
+    if (other != NULL && other->int_id_ > sf->int_id_)
+    {
+      Person person;
+      person.track_id    = sf->int_id_;
+      person.name        = sf->object_id;
+      person.object_id   = sf->id_ + "|" + other->id_;
+      person.position    = (sf->position_ + other->position_) / 2;
+      person.velocity    = (sf->velocity_ + other->velocity_) / 2;
+      person.reliability = sf->reliability * other->reliability;
+      person.stamp       = sf->time_;
+      result.people.push_back(person);
+    }
+  }
+}
+
+// Find the trackers that are closest to this person position
+// If a tracker was already assigned to a person, keep this assignment when the distance between them is not too large.
+void LegDetectorCore::seedPerson(const std::string& person_id, const Vector3& person_loc)
+{
+  // If there are no legs, return.
+  if (saved_features_.empty())
+    return;
+
+  list<SavedFeature*>::iterator closest = saved_features_.end();
+  list<SavedFeature*>::iterator closest1 = saved_features_.end();
+  list<SavedFeature*>::iterator closest2 = saved_features_.end();
+  float closest_dist = params_.max_meas_jump;
+  float closest_pair_dist = 2 * params_.max_meas_jump;
+
+  list<SavedFeature*>::iterator begin = saved_features_.begin();
+  list<SavedFeature*>::iterator end = saved_features_.end();
+  list<SavedFeature*>::iterator it1, it2;
+
+  // If there's a pair of legs with the right label and within the max dist, return
+  // If there's one leg with the right label and within the max dist,
+  //   find a partner for it from the unlabeled legs whose tracks are reasonably new.
+  //   If no partners exist, label just the one leg.
+  // If there are no legs with the right label and within the max dist,
+  //   find a pair of unlabeled legs and assign them the label.
+  // If all of the above cases fail,
+  //   find a new unlabeled leg and assign the label.
+
+  // For each tracker, get the distance to this person.
+  for (it1 = begin; it1 != end; ++it1)
+    (*it1)->dist_to_person_ = (person_loc - (*it1)->position_).length();
+
+  // Try to find one or two trackers with the same label and within the max distance of the person.
+  cout << "Looking for two legs" << endl;
+  it2 = end;
+  for (it1 = begin; it1 != end; ++it1)
+  {
+    // If this leg belongs to the person...
+    if ((*it1)->object_id == person_id)
+    {
+      // and their distance is close enough...
+      if ((*it1)->dist_to_person_ < params_.max_meas_jump)
+      {
+        // if this is the first leg we've found, assign it to it2. Otherwise, leave it assigned to it1 and break.
+        if (it2 == end)
+          it2 = it1;
+        else
+          break;
+      }
+      // Otherwise, remove the tracker's label, it doesn't belong to this person.
+      else
+      {
+        // the two trackers moved apart. This should not happen.
+        (*it1)->object_id = "";
+      }
+    }
+  }
+  // If we found two legs with the right label and within the max distance, all is good, return.
+  if (it1 != end && it2 != end)
+  {
+    cout << "Found matching pair. The second distance was " << (*it1)->dist_to_person_ << endl;
+    return;
+  }
+
+
+
+  // If we only found one close leg with the right label, let's try to find a second leg that
+  //   * doesn't yet have a label  (=valid precondition),
+  //   * is within the max distance,
+  //   * is less than max_second_leg_age_s old.
+  cout << "Looking for one leg plus one new leg" << endl;
+  float dist_between_legs, closest_dist_between_legs;
+  if (it2 != end)
+  {
+    closest_dist = params_.max_meas_jump;
+    closest = saved_features_.end();
+
+    for (it1 = begin; it1 != end; ++it1)
+    {
+      // Skip this leg track if:
+      // - you're already using it.
+      // - it already has an id.
+      // - it's too old. Old unassigned trackers are unlikely to be the second leg in a pair.
+      // - it's too far away from the person.
+      if ((it1 == it2) || ((*it1)->object_id != "") || ((*it1)->getLifetime() > params_.max_second_leg_age) || ((*it1)->dist_to_person_ >= closest_dist))
+        continue;
+
+      // Get the distance between the two legs
+      dist_between_legs = ((*it2)->position_ - (*it1)->position_).length();
+
+      // If this is the closest dist (and within range), and the legs are close together and unlabeled, mark it.
+      if (dist_between_legs < params_.leg_pair_separation)
+      {
+        closest = it1;
+        closest_dist = (*it1)->dist_to_person_;
+        closest_dist_between_legs = dist_between_legs;
+      }
+    }
+    // If we found a close, unlabeled leg, set it's label.
+    if (closest != end)
+    {
+      cout << "Replaced one leg with a distance of " << closest_dist << " and a distance between the legs of " << closest_dist_between_legs << endl;
+      (*closest)->object_id = person_id;
+    }
+    else
+    {
+      cout << "Returned one matched leg only" << endl;
+    }
+
+    // Regardless of whether we found a second leg, return.
+    return;
+  }
+
+  cout << "Looking for a pair of new legs" << endl;
+  // If we didn't find any legs with this person's label, try to find two unlabeled legs that are close together and close to the tracker.
+  it1 = saved_features_.begin();
+  it2 = saved_features_.begin();
+  closest = saved_features_.end();
+  closest1 = saved_features_.end();
+  closest2 = saved_features_.end();
+  closest_dist = params_.max_meas_jump;
+  closest_pair_dist = 2 * params_.max_meas_jump;
+  for (; it1 != end; ++it1)
+  {
+    // Only look at trackers without ids and that are not too far away.
+    if ((*it1)->object_id != "" || (*it1)->dist_to_person_ >= params_.max_meas_jump)
+      continue;
+
+    // Keep the single closest leg around in case none of the pairs work out.
+    if ((*it1)->dist_to_person_ < closest_dist)
+    {
+      closest_dist = (*it1)->dist_to_person_;
+      closest = it1;
+    }
+
+    // Find a second leg.
+    it2 = it1;
+    it2++;
+    for (; it2 != end; ++it2)
+    {
+      // Only look at trackers without ids and that are not too far away.
+      if ((*it2)->object_id != "" || (*it2)->dist_to_person_ >= params_.max_meas_jump)
+        continue;
+
+      // Get the distance between the two legs
+      dist_between_legs = ((*it2)->position_ - (*it1)->position_).length();
+
+      // Ensure that this pair of legs is the closest pair to the tracker, and that the distance between the legs isn't too large.
+      if ((*it1)->dist_to_person_ + (*it2)->dist_to_person_ < closest_pair_dist && dist_between_legs < params_.leg_pair_separation)
+      {
+        closest_pair_dist = (*it1)->dist_to_person_ + (*it2)->dist_to_person_;
+        closest1 = it1;
+        closest2 = it2;
+        closest_dist_between_legs = dist_between_legs;
+      }
+    }
+  }
+  // Found a pair of legs.
+  if (closest1 != end && closest2 != end)
+  {
+    (*closest1)->object_id = person_id;
+    (*closest2)->object_id = person_id;
+    cout << "Found a completely new pair with total distance " << closest_pair_dist << " and a distance between the legs of " << closest_dist_between_legs << endl;
+    return;
+  }
+
+  cout << "Looking for just one leg" << endl;
+  // No pair worked, try for just one leg.
+  if (closest != end)
+  {
+    (*closest)->object_id = person_id;
+    cout << "Returned one new leg only" << endl;
+    return;
+  }
+
+  cout << "Nothing matched" << endl;
+}
+
+void LegDetectorCore::pairLegs()
+{
+  // Deal With legs that already have ids
+  list<SavedFeature*>::iterator begin = saved_features_.begin();
+  list<SavedFeature*>::iterator end = saved_features_.end();
+  list<SavedFeature*>::iterator leg1, leg2, best, it;
+
+  for (leg1 = begin; leg1 != end; ++leg1)
+  {
+    // If this leg has no id, skip
+    if ((*leg1)->object_id == "")
+      continue;
+
+    leg2 = end;
+    best = end;
+    double closest_dist = params_.leg_pair_separation;
+    for (it = begin; it != end; ++it)
+    {
+      if (it == leg1) continue;
+
+      if ((*it)->object_id == (*leg1)->object_id)
+      {
+        leg2 = it;
+        break;
+      }
+
+      if ((*it)->object_id != "")
+        continue;
+
+      double d = (*it)->position_.distance((*leg1)->position_);
+      if (((*it)->getLifetime() <= params_.max_second_leg_age)
+          && (d < closest_dist))
+      {
+        closest_dist = d;
+        best = it;
+      }
+
+    }
+
+    if (leg2 != end)
+    {
+      double dist_between_legs = (*leg1)->position_.distance((*leg2)->position_);
+      if (dist_between_legs > params_.leg_pair_separation)
+      {
+        (*leg1)->object_id = "";
+        (*leg1)->other = NULL;
+        (*leg2)->object_id = "";
+        (*leg2)->other = NULL;
+      }
+      else
+      {
+        (*leg1)->other = *leg2;
+        (*leg2)->other = *leg1;
+      }
+    }
+    else if (best != end)
+    {
+      (*best)->object_id = (*leg1)->object_id;
+      (*leg1)->other = *best;
+      (*best)->other = *leg1;
+    }
+  }
+
+  // Attempt to pair up legs with no id
+  for (;;)
+  {
+    list<SavedFeature*>::iterator best1 = end, best2 = end;
+    double closest_dist = params_.leg_pair_separation;
+
+    for (leg1 = begin; leg1 != end; ++leg1)
+    {
+      // If this leg has an id or low reliability, skip
+      if ((*leg1)->object_id != ""
+          || (*leg1)->getReliability() < params_.leg_reliability_limit)
+        continue;
+
+      for (leg2 = begin; leg2 != end; ++leg2)
+      {
+        if (((*leg2)->object_id != "")
+            || ((*leg2)->getReliability() < params_.leg_reliability_limit)
+            || (leg1 == leg2)) continue;
+        double d = (*leg1)->position_.distance((*leg2)->position_);
+        if (d < closest_dist)
+        {
+          best1 = leg1;
+          best2 = leg2;
+        }
+      }
+    }
+
+    if (best1 != end)
+    {
+      char id[100];
+      snprintf(id, 100, "Person%d", next_p_id_++);
+      (*best1)->object_id = std::string(id);
+      (*best2)->object_id = std::string(id);
+      (*best1)->other = *best2;
+      (*best2)->other = *best1;
+    }
+    else
+    {
+      break;
+    }
+  }
+}
+
+void writeDetections(FILE* out, const LegDetectorResult& result)
+{
+  fprintf(out, "scan %.6f %lu %lu %u\n", result.stamp,
+          (unsigned long)result.legs.size(), (unsigned long)result.people.size(), result.degraded);
+  for (vector<Leg>::const_iterator leg = result.legs.begin(); leg != result.legs.end(); leg++)
+    fprintf(out, "leg %d %.4f %.4f %.4f %.4f %.4f %.4f %s\n", leg->track_id,
+            leg->position[0], leg->position[1], leg->velocity[0], leg->velocity[1],
+            leg->reliability, leg->stamp, leg->object_id.c_str());
+  for (vector<Person>::const_iterator person = result.people.begin(); person != result.people.end(); person++)
+    fprintf(out, "person %d %.4f %.4f %.4f %.4f %.4f %.4f %s\n", person->track_id,
+            person->position[0], person->position[1], person->velocity[0], person->velocity[1],
+            person->reliability, person->stamp, person->object_id.c_str());
+}
+};
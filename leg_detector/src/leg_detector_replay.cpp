@@ -0,0 +1,397 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+// Replays the laser scans of a bag through the leg detection pipeline as fast as possible,
+// without a ROS master, and reports the throughput and per-stage timing of the pipeline.
+// Every scan topic is a scanner of its own, and each scan is tracked as the node tracks it.
+//
+// Usage: leg_detector_replay <model_file> <bag> [options]
+//   -s <topic>       scan topic, by default every sensor_msgs/LaserScan in the bag
+//   -f <frame>       fixed frame, default odom_combined
+//   -o <file>        write the detected legs and people to this file
+//   -m <file>        background scan mask, as saved by the node or the trainer. With several
+//                    scan topics, suffixed with the topic as the node does
+//   -p <name=value>  override a detector parameter, using the names of cfg/LegDetector.cfg
+
+#include <leg_detector/leg_detector_core.h>
+
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/LaserScan.h>
+#include <tf/tf.h>
+#include <tf2_msgs/TFMessage.h>
+
+#include <boost/foreach.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace leg_detector;
+
+// Scans wait at most this long, in bag time, for the transform into the fixed frame.
+static const double TF_TOLERANCE = 1.0;
+
+static bool setParam(LegDetectorParams& params, const string& assignment)
+{
+  size_t eq = assignment.find('=');
+  if (eq == string::npos)
+    return false;
+
+  string name = assignment.substr(0, eq);
+  double value = atof(assignment.c_str() + eq + 1);
+
+  if (name == "connection_threshold")        params.connected_thresh = value;
+  else if (name == "min_points_per_group")   params.min_points_per_group = (int)value;
+  else if (name == "leg_reliability_limit")  params.leg_reliability_limit = value;
+  else if (name == "no_observation_timeout") params.no_observation_timeout = value;
+  else if (name == "max_second_leg_age")     params.max_second_leg_age = value;
+  else if (name == "max_track_jump")         params.max_track_jump = value;
+  else if (name == "max_meas_jump")          params.max_meas_jump = value;
+  else if (name == "leg_pair_separation")    params.leg_pair_separation = value;
+  else if (name == "kalman_p")               params.kal_p = value;
+  else if (name == "kalman_q")               params.kal_q = value;
+  else if (name == "kalman_r")               params.kal_r = value;
+  else if (name == "kalman_on")              params.use_filter = value != 0;
+  else if (name == "roi_full_scan_interval") params.roi_full_scan_interval = (int)value;
+  else if (name == "roi_change_threshold")   params.roi_change_threshold = value;
+  else if (name == "reuse_max_scans")        params.reuse_max_scans = (int)value;
+  else if (name == "reuse_min_reliability")  params.reuse_min_reliability = value;
+  else if (name == "reuse_feature_drift")    params.reuse_feature_drift = value;
+  else if (name == "max_tracks")             params.max_tracks = (int)value;
+  else if (name == "birth_probability")      params.birth_probability = value;
+  else if (name == "scan_deadline")          params.scan_deadline = value;
+  else if (name == "fusion_distance")        params.fusion_distance = value;
+  else
+    return false;
+  return true;
+}
+
+static double percentile(vector<double> values, double q)
+{
+  if (values.empty())
+    return 0.0;
+  size_t k = (size_t)(q * (values.size() - 1) + 0.5);
+  nth_element(values.begin(), values.begin() + k, values.end());
+  return values[k];
+}
+
+// The state of one scanner
+struct ReplayChannel
+{
+  int index;
+  ScanChannel scan_channel;
+};
+
+class LegDetectorReplay
+{
+public:
+  LegDetectorReplay(LegDetectorCore& core, const string& fixed_frame, FILE* out)
+    : core_(core), fixed_frame_(fixed_frame), out_(out),
+      transformer_(true, ros::Duration(TF_TOLERANCE * 10)),
+      scans_(0), scans_dropped_(0), scans_degraded_(0), process_time_(0.0)
+  {
+#if LEG_DETECTOR_PROFILING
+    for (int i = 0; i < NUM_SCAN_STAGES; i++)
+      stage_total_[i] = 0.0;
+    beams_total_ = 0.0;
+#endif
+  }
+
+  void addTransforms(const tf2_msgs::TFMessage& msg, bool is_static)
+  {
+    BOOST_FOREACH(const geometry_msgs::TransformStamped& t, msg.transforms)
+    {
+      tf::StampedTransform transform;
+      tf::transformStampedMsgToTF(t, transform);
+      if (is_static)
+        static_transforms_.push_back(transform);
+      else
+        transformer_.setTransform(transform, "replay");
+    }
+  }
+
+  // Adds a scanner, with the background mask of the given file if any. Returns false if the
+  // mask cannot be loaded.
+  bool addChannel(const string& topic, const string& mask_file)
+  {
+    ReplayChannel& channel = channels_[topic];
+    channel.index = channels_.size() - 1;
+    return mask_file.empty() || channel.scan_channel.mask.load(mask_file);
+  }
+
+  void addScan(const string& topic, const sensor_msgs::LaserScan::ConstPtr& scan)
+  {
+    pending_.push_back(make_pair(topic, scan));
+  }
+
+  // Processes the pending scans, in order, as soon as their transform is known.
+  // Scans that are still unresolved TF_TOLERANCE after their stamp are dropped,
+  // as the tf::MessageFilter in front of the node would.
+  void flush(const ros::Time& now, bool final)
+  {
+    while (!pending_.empty())
+    {
+      const string& topic = pending_.front().first;
+      sensor_msgs::LaserScan::ConstPtr scan = pending_.front().second;
+      const ros::Time& stamp = scan->header.stamp;
+
+      // Static transforms have no time, restamp them for every lookup
+      for (size_t i = 0; i < static_transforms_.size(); i++)
+      {
+        static_transforms_[i].stamp_ = stamp;
+        transformer_.setTransform(static_transforms_[i], "replay_static");
+      }
+
+      if (transformer_.canTransform(fixed_frame_, scan->header.frame_id, stamp))
+      {
+        process(channels_[topic], scan);
+      }
+      else if (final || now - stamp > ros::Duration(TF_TOLERANCE))
+      {
+        scans_dropped_++;
+      }
+      else
+      {
+        return;
+      }
+      pending_.pop_front();
+    }
+  }
+
+  void report() const
+  {
+    printf("Processed %lu scans, dropped %lu without transform\n", scans_, scans_dropped_);
+    if (scans_ == 0)
+      return;
+
+    printf("Pipeline time %.3f s, %.1f scans/sec\n", process_time_, scans_ / process_time_);
+    printf("Scans degraded to meet the deadline: %lu\n", scans_degraded_);
+    printf("Leg tracks: peak %lu, evicted %lu, rejected births %lu\n",
+           (unsigned long)core_.getPeakTrackCount(), core_.getEvictedTrackCount(), core_.getRejectedBirthCount());
+    printf("Per scan [ms]: mean %.3f  p50 %.3f  p99 %.3f  max %.3f\n",
+           process_time_ / scans_ * 1e3,
+           percentile(scan_time_, 0.5) * 1e3,
+           percentile(scan_time_, 0.99) * 1e3,
+           *max_element(scan_time_.begin(), scan_time_.end()) * 1e3);
+
+#if LEG_DETECTOR_PROFILING
+    printf("Beams segmented per scan: mean %.1f\n", beams_total_ / scans_);
+    for (int i = 0; i < NUM_SCAN_STAGES; i++)
+      printf("  %-10s mean %.3f ms  (%4.1f%%)\n", scanStageName(i),
+             stage_total_[i] / scans_ * 1e3, 100.0 * stage_total_[i] / process_time_);
+#endif
+  }
+
+private:
+  LegDetectorCore& core_;
+  string fixed_frame_;
+  FILE* out_;
+
+  tf::Transformer transformer_;
+  vector<tf::StampedTransform> static_transforms_;
+  deque<pair<string, sensor_msgs::LaserScan::ConstPtr> > pending_;
+  map<string, ReplayChannel> channels_;
+
+  LegDetectorResult result_;
+
+  unsigned long scans_;
+  unsigned long scans_dropped_;
+  unsigned long scans_degraded_;
+  double process_time_;
+  vector<double> scan_time_;
+#if LEG_DETECTOR_PROFILING
+  double stage_total_[NUM_SCAN_STAGES];
+  double beams_total_;
+#endif
+
+  void process(ReplayChannel& channel, const sensor_msgs::LaserScan::ConstPtr& scan)
+  {
+    tf::StampedTransform sensor_pose;
+    transformer_.lookupTransform(fixed_frame_, scan->header.frame_id, scan->header.stamp, sensor_pose);
+
+    // Only the pipeline itself is timed, not reading the bag or writing the output
+    double start = monotonicNow();
+    core_.processScan(scan, &sensor_pose, channel.index, channel.scan_channel, result_);
+    double elapsed = monotonicNow() - start;
+
+#if LEG_DETECTOR_PROFILING
+    const ScanProfile& profile = core_.getProfile();
+    for (int i = 0; i < NUM_SCAN_STAGES; i++)
+      stage_total_[i] += profile.stage_time[i];
+    beams_total_ += profile.beams;
+#endif
+    core_.commitProfile();
+
+    scans_++;
+    if (result_.degraded)
+      scans_degraded_++;
+    process_time_ += elapsed;
+    scan_time_.push_back(elapsed);
+
+    if (out_)
+      writeDetections(out_, result_);
+  }
+};
+
+static void usage()
+{
+  fprintf(stderr,
+          "Usage: leg_detector_replay <model_file> <bag> [-s scan_topic] [-f fixed_frame]\n"
+          "                           [-o output_file] [-m mask_file] [-p name=value ...]\n");
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    usage();
+    return 1;
+  }
+
+  string model_file = argv[1];
+  string bag_file = argv[2];
+  string scan_topic;
+  string fixed_frame = "odom_combined";
+  string output_file;
+  string mask_file;
+  LegDetectorParams params;
+
+  for (int i = 3; i < argc; i++)
+  {
+    string arg = argv[i];
+    if (i + 1 >= argc)
+    {
+      usage();
+      return 1;
+    }
+    if (arg == "-s")
+      scan_topic = argv[++i];
+    else if (arg == "-f")
+      fixed_frame = argv[++i];
+    else if (arg == "-o")
+      output_file = argv[++i];
+    else if (arg == "-m")
+      mask_file = argv[++i];
+    else if (arg == "-p" && setParam(params, argv[i + 1]))
+      i++;
+    else
+    {
+      usage();
+      return 1;
+    }
+  }
+
+  LegDetectorCore core;
+  if (!core.loadModel(model_file))
+  {
+    fprintf(stderr, "Could not load a random forests classifier from %s\n", model_file.c_str());
+    return 1;
+  }
+  core.setParams(params);
+
+  FILE* out = NULL;
+  if (!output_file.empty())
+  {
+    out = fopen(output_file.c_str(), "w");
+    if (out == NULL)
+    {
+      fprintf(stderr, "Could not open %s for writing\n", output_file.c_str());
+      return 1;
+    }
+  }
+
+  LegDetectorReplay replay(core, fixed_frame, out);
+
+  try
+  {
+    rosbag::Bag bag(bag_file, rosbag::bagmode::Read);
+    rosbag::View view(bag);
+
+    // The scanners are known up front, so that their masks are named as the node names them
+    vector<string> topics;
+    BOOST_FOREACH(const rosbag::ConnectionInfo* connection, view.getConnections())
+      if (connection->datatype == "sensor_msgs/LaserScan"
+          && (scan_topic.empty() || connection->topic == scan_topic)
+          && find(topics.begin(), topics.end(), connection->topic) == topics.end())
+        topics.push_back(connection->topic);
+
+    for (size_t i = 0; i < topics.size(); i++)
+    {
+      string suffix = topics[i];
+      replace(suffix.begin(), suffix.end(), '/', '_');
+      string file = mask_file.empty() || topics.size() == 1 ? mask_file : mask_file + "." + suffix;
+      if (!replay.addChannel(topics[i], file))
+      {
+        fprintf(stderr, "Could not load a scan mask from %s\n", file.c_str());
+        return 1;
+      }
+    }
+
+    BOOST_FOREACH(const rosbag::MessageInstance& m, view)
+    {
+      if (m.getTopic() == "/tf" || m.getTopic() == "/tf_static")
+      {
+        // tf/tfMessage and tf2_msgs/TFMessage share their definition
+        tf2_msgs::TFMessage::ConstPtr tf_msg = m.instantiate<tf2_msgs::TFMessage>();
+        if (tf_msg)
+          replay.addTransforms(*tf_msg, m.getTopic() == "/tf_static");
+      }
+      else if (find(topics.begin(), topics.end(), m.getTopic()) != topics.end())
+      {
+        sensor_msgs::LaserScan::ConstPtr scan = m.instantiate<sensor_msgs::LaserScan>();
+        if (scan)
+          replay.addScan(m.getTopic(), scan);
+      }
+      replay.flush(m.getTime(), false);
+    }
+    replay.flush(ros::Time(), true);
+  }
+  catch (rosbag::BagException& e)
+  {
+    fprintf(stderr, "Could not read %s: %s\n", bag_file.c_str(), e.what());
+    return 1;
+  }
+
+  if (out)
+    fclose(out);
+
+  replay.report();
+  return 0;
+}
@@ -42,6 +42,8 @@
 #include "people_msgs/PositionMeasurement.h"
 #include "sensor_msgs/LaserScan.h"
 
+#include <fstream>
+
 using namespace std;
 using namespace laser_processor;
 using namespace ros;
@@ -53,6 +55,8 @@ class TrainLegDetector
 public:
   ScanMask mask_;
   int mask_count_;
+  string mask_file_;
+  bool save_mask_;    // the mask file could not be loaded, the first mask built goes there
 
   vector< vector<float> > pos_data_;
   vector< vector<float> > neg_data_;
@@ -64,7 +68,7 @@ public:
 
   int feat_count_;
 
-  TrainLegDetector() : mask_count_(0), connected_thresh_(0.06), feat_count_(0)
+  TrainLegDetector() : mask_count_(0), save_mask_(false), connected_thresh_(0.06), feat_count_(0)
   {
   }
 
@@ -93,6 +97,16 @@ public:
         mask_.clear();
         mask_count_ = 0;
 
+        // A saved mask replaces the one built from the first scans of each bag. If there is none
+        // yet, the first mask built is saved, but a file that was given is never overwritten.
+        if (load != LOADING_NEG && !mask_file_.empty())
+        {
+          if (mask_.load(mask_file_))
+            mask_count_ = 20;
+          else
+            save_mask_ = !ifstream(mask_file_.c_str()).good();
+        }
+
         switch (load)
         {
         case LOADING_POS:
@@ -119,9 +133,21 @@ public:
   {
     vector< vector<float> >* data = (vector< vector<float> >*)(n);
 
+    if (!mask_.empty() && !mask_.matches(*scan))
+    {
+      printf("Scan mask does not match the scans of %s, rebuilding it\n", name.c_str());
+      mask_.clear();
+      mask_count_ = 0;
+    }
+
     if (mask_count_++ < 20)
     {
       mask_.addScan(*scan);
+      if (mask_count_ == 20 && save_mask_ && mask_.save(mask_file_))
+      {
+        printf("Saved scan mask as: %s\n", mask_file_.c_str());
+        save_mask_ = false;
+      }
     }
     else
     {
@@ -270,6 +296,12 @@ int main(int argc, char **argv)
         strncpy(save_file, argv[i], 100);
       continue;
     }
+    else if (!strcmp(argv[i], "--mask"))
+    {
+      if (++i < argc)
+        tld.mask_file_ = argv[i];
+      continue;
+    }
     else
       tld.loadData(loading, argv[i]);
   }
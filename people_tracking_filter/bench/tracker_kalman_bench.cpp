@@ -0,0 +1,140 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+// Microbenchmarks of one predict and correct step of the Kalman trackers, BFL's TrackerKalman
+// against TrackerKalmanFixed and a TrackerBank, for the number of people tracked at once.
+
+#include <people_tracking_filter/tracker_kalman.h>
+#include <people_tracking_filter/tracker_kalman_fixed.h>
+#include <people_tracking_filter/tracker_bank.h>
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+using namespace estimation;
+using namespace BFL;
+
+// People walking along x at 1 m/s, measured at 10 Hz
+static const double STEP = 0.1;
+
+static void peopleCounts(benchmark::internal::Benchmark* b)
+{
+  b->RangeMultiplier(10)->Range(1, 1000)->ArgName("people");
+}
+
+template <class T>
+static void BM_Kalman(benchmark::State& state)
+{
+  // with the system noise of launch/filter.launch
+  StatePosVel sys_sigma(tf::Vector3(0.8, 0.8, 0.3), tf::Vector3(0.5, 0.5, 0.5));
+  std::vector<T*> trackers;
+  for (int i = 0; i < state.range(0); i++)
+  {
+    trackers.push_back(new T("bench", sys_sigma));
+    trackers.back()->initialize(StatePosVel(tf::Vector3(0, i, 0), tf::Vector3(1, 0, 0)),
+                                StatePosVel(tf::Vector3(0.1, 0.1, 0.1), tf::Vector3(1e-7, 1e-7, 1e-7)), 0.0);
+  }
+
+  MatrixWrapper::SymmetricMatrix cov(3);
+  cov = 0.0;
+  cov(1, 1) = 0.0025;
+  cov(2, 2) = 0.0025;
+  cov(3, 3) = 0.0025;
+
+  double time = 0.0;
+  while (state.KeepRunning())
+  {
+    time += STEP;
+    for (size_t i = 0; i < trackers.size(); i++)
+    {
+      trackers[i]->updatePrediction(time);
+      trackers[i]->updateCorrection(tf::Vector3(time, i, 0), cov);
+      StatePosVel est;
+      trackers[i]->getEstimate(est);
+      benchmark::DoNotOptimize(est);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+
+  for (size_t i = 0; i < trackers.size(); i++)
+    delete trackers[i];
+}
+
+// All people predicted in one pass of the bank, and corrected in one batch
+static void BM_KalmanBank(benchmark::State& state)
+{
+  StatePosVel sys_sigma(tf::Vector3(0.8, 0.8, 0.3), tf::Vector3(0.5, 0.5, 0.5));
+  TrackerBank bank(sys_sigma);
+  std::vector<TrackerBankView*> trackers;
+  std::vector<TrackerBank::Correction> corrections(state.range(0));
+  for (int i = 0; i < state.range(0); i++)
+  {
+    trackers.push_back(bank.createTracker("bench"));
+    trackers.back()->initialize(StatePosVel(tf::Vector3(0, i, 0), tf::Vector3(1, 0, 0)),
+                                StatePosVel(tf::Vector3(0.1, 0.1, 0.1), tf::Vector3(1e-7, 1e-7, 1e-7)), 0.0);
+    corrections[i].slot = trackers.back()->getSlot();
+    for (unsigned int j = 0; j < 3; j++)
+      for (unsigned int k = 0; k < 3; k++)
+        corrections[i].cov[j][k] = j == k ? 0.0025 : 0.0;
+  }
+
+  double time = 0.0;
+  while (state.KeepRunning())
+  {
+    time += STEP;
+    bank.updatePrediction(time);
+    for (size_t i = 0; i < corrections.size(); i++)
+    {
+      corrections[i].meas[0] = time;
+      corrections[i].meas[1] = i;
+      corrections[i].meas[2] = 0;
+    }
+    bank.updateCorrection(corrections);
+    for (size_t i = 0; i < trackers.size(); i++)
+    {
+      StatePosVel est;
+      trackers[i]->getEstimate(est);
+      benchmark::DoNotOptimize(est);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+
+  for (size_t i = 0; i < trackers.size(); i++)
+    delete trackers[i];
+}
+
+BENCHMARK_TEMPLATE(BM_Kalman, TrackerKalman)->Apply(peopleCounts)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_Kalman, TrackerKalmanFixed)->Apply(peopleCounts)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_KalmanBank)->Apply(peopleCounts)->Unit(benchmark::kMicrosecond);
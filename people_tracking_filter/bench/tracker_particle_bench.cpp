@@ -0,0 +1,83 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+// Microbenchmarks of one predict and correct step of the particle trackers, BFL's TrackerParticle
+// against TrackerParticleSoA, with 1k to 100k particles. Results can be saved for comparison with
+//   people_tracking_filter_bench --benchmark_out=results.json --benchmark_out_format=json
+
+#include <people_tracking_filter/tracker_particle.h>
+#include <people_tracking_filter/tracker_particle_soa.h>
+
+#include <benchmark/benchmark.h>
+
+using namespace estimation;
+using namespace BFL;
+
+// A person walking along x at 1 m/s, measured at 10 Hz
+static const double STEP = 0.1;
+
+static void particleCounts(benchmark::internal::Benchmark* b)
+{
+  b->RangeMultiplier(10)->Range(1000, 100000)->ArgName("particles");
+}
+
+template <class T>
+static void BM_Track(benchmark::State& state)
+{
+  StatePosVel sys_sigma(tf::Vector3(0.05, 0.05, 0.05), tf::Vector3(1.0, 1.0, 1.0));
+  T tracker("bench", state.range(0), sys_sigma);
+  tracker.initialize(StatePosVel(tf::Vector3(0, 0, 0), tf::Vector3(1, 0, 0)),
+                     StatePosVel(tf::Vector3(0.1, 0.1, 0.1), tf::Vector3(0.1, 0.1, 0.1)), 0.0);
+
+  MatrixWrapper::SymmetricMatrix cov(3);
+  cov = 0.0;
+  cov(1, 1) = 0.0025;
+  cov(2, 2) = 0.0025;
+  cov(3, 3) = 0.0025;
+
+  double time = 0.0;
+  while (state.KeepRunning())
+  {
+    time += STEP;
+    tracker.updatePrediction(time);
+    tracker.updateCorrection(tf::Vector3(time, 0, 0), cov);
+    StatePosVel est;
+    tracker.getEstimate(est);
+    benchmark::DoNotOptimize(est);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_TEMPLATE(BM_Track, TrackerParticle)->Apply(particleCounts)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_Track, TrackerParticleSoA)->Apply(particleCounts)->Unit(benchmark::kMicrosecond);
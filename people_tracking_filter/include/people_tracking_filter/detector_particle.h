@@ -44,6 +44,7 @@
 #include "mcpdf_vector.h"
 #include "measmodel_vector.h"
 #include "sysmodel_vector.h"
+#include "fast_rng.h"
 
 // TF
 #include <tf/tf.h>
@@ -97,12 +98,26 @@ public:
   /// Get histogram from certain area
   MatrixWrapper::Matrix getHistogram(const tf::Vector3& min, const tf::Vector3& max, const tf::Vector3& step) const;
 
+  /// restart the random numbers, for reproducible runs
+  void seed(uint64_t seed)
+  {
+    rng_.seed(seed);
+  };
+
+  /// resample when the effective sample size drops below this fraction of the particles
+  void setResampleFraction(double fraction)
+  {
+    resampler_.fractionSet(fraction);
+  };
+
 private:
   // pdf / model / filter
   BFL::MCPdfVector                                          prior_;
   BFL::BootstrapFilter<tf::Vector3, tf::Vector3>* filter_;
   BFL::SysModelVector                                       sys_model_;
   BFL::MeasModelVector                                      meas_model_;
+  BFL::FastRng                                              rng_;
+  BFL::Resampler<tf::Vector3>                               resampler_;
 
   // vars
   bool detector_initialized_;
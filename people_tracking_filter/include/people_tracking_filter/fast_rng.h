@@ -0,0 +1,105 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef FAST_RNG_H
+#define FAST_RNG_H
+
+#include <stdint.h>
+#include <string>
+
+namespace BFL
+{
+/// Random numbers for the sampling pdfs and particle trackers of this package. Several
+/// xoshiro128+ streams advance in lockstep, and Box-Muller turns whole blocks of their output
+/// into normal variates, in loops without branches that the compiler vectorizes. Single variates
+/// are served from a buffered block. A generator is not thread safe, give every tracker its own
+/// so that runs with the same seeds are reproducible.
+class FastRng
+{
+public:
+  /// number of independent streams
+  static const unsigned int LANES = 8;
+
+  /// number of variates generated at once
+  static const unsigned int BLOCK = 256;
+
+  /// Constructor
+  explicit FastRng(uint64_t seed = 0x2545f4914f6cdd1dULL);
+
+  /// restart the sequence from a seed
+  void seed(uint64_t seed);
+
+  /// a seed derived from a string, e.g. the name of a tracker
+  static uint64_t seedFrom(const std::string& key);
+
+  /// standard normal variate
+  float normal()
+  {
+    if (next_normal_ == BLOCK)
+      refillNormal();
+    return normal_[next_normal_++];
+  };
+
+  /// uniform variate in [0, 1)
+  float uniform()
+  {
+    if (next_uniform_ == BLOCK)
+      refillUniform();
+    return uniform_[next_uniform_++];
+  };
+
+  /// fill a buffer with standard normal variates
+  void fillNormal(float* out, unsigned int n);
+
+  /// fill a buffer with uniform variates in [0, 1)
+  void fillUniform(float* out, unsigned int n);
+
+  /// the generator of the calling thread, for pdfs that were not given one
+  static FastRng& threadDefault();
+
+private:
+  uint32_t state_[4][LANES];
+  uint32_t bits_[BLOCK];
+  float normal_[BLOCK], uniform_[BLOCK];
+  unsigned int next_normal_, next_uniform_;
+
+  void generate(uint32_t* out, unsigned int n);
+  void normalBlock(float* out);
+  void uniformBlock(float* out);
+  void refillNormal();
+  void refillUniform();
+};
+
+} // end namespace
+#endif
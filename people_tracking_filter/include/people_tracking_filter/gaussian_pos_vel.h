@@ -51,6 +51,7 @@ private:
   StatePosVel mu_, sigma_;
   GaussianVector gauss_pos_, gauss_vel_;
   mutable double dt_;
+  FastRng* rng_;
 
 public:
   /// Constructor
@@ -71,6 +72,12 @@ public:
     dt_ = dt;
   };
 
+  /// draw samples from rng, or from the generator of the calling thread if it is NULL
+  void SetRng(FastRng* rng)
+  {
+    rng_ = rng;
+  };
+
   // Redefinition of pure virtuals
   virtual Probability ProbabilityGet(const StatePosVel& input) const;
   bool SampleFrom(vector<Sample<StatePosVel> >& list_samples, const int num_samples, int method = DEFAULT, void * args = NULL) const;
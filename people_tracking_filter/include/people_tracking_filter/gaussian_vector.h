@@ -39,6 +39,7 @@
 
 #include <pdf/pdf.h>
 #include <tf/tf.h>
+#include "fast_rng.h"
 
 
 
@@ -52,6 +53,7 @@ private:
   mutable double sqrt_;
   mutable tf::Vector3 sigma_sq_;
   mutable bool sigma_changed_;
+  FastRng* rng_;
 
 public:
   /// Constructor
@@ -65,6 +67,12 @@ public:
 
   void sigmaSet(const tf::Vector3& sigma);
 
+  /// draw samples from rng, or from the generator of the calling thread if it is NULL
+  void SetRng(FastRng* rng)
+  {
+    rng_ = rng;
+  };
+
   // Redefinition of pure virtuals
   virtual Probability ProbabilityGet(const tf::Vector3& input) const;
   bool SampleFrom(vector<Sample<tf::Vector3> >& list_samples, const int num_samples, int method = DEFAULT, void * args = NULL) const;
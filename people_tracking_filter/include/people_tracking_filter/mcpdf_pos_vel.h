@@ -41,6 +41,7 @@
 #include "state_pos_vel.h"
 #include <tf/tf.h>
 #include <sensor_msgs/PointCloud.h>
+#include "resampler.h"
 
 namespace BFL
 {
@@ -67,6 +68,9 @@ public:
   virtual WeightedSample<StatePosVel> SampleGet(unsigned int particle) const;
   virtual unsigned int numParticlesGet() const;
 
+  /// Resample the particles in place when the resampler finds it necessary, returns true if it did
+  bool resample(Resampler<StatePosVel>& resampler, FastRng& rng);
+
 private:
   /// Get histogram from certain area
   MatrixWrapper::Matrix getHistogram(const tf::Vector3& min, const tf::Vector3& max, const tf::Vector3& step, bool pos_hist) const;
@@ -40,6 +40,7 @@
 #include <pdf/mcpdf.h>
 #include <tf/tf.h>
 #include <sensor_msgs/PointCloud.h>
+#include "resampler.h"
 
 namespace BFL
 {
@@ -63,6 +64,9 @@ public:
   virtual WeightedSample<tf::Vector3> SampleGet(unsigned int particle) const;
   virtual unsigned int numParticlesGet() const;
 
+  /// Resample the particles in place when the resampler finds it necessary, returns true if it did
+  bool resample(Resampler<tf::Vector3>& resampler, FastRng& rng);
+
 };
 
 
@@ -38,21 +38,27 @@
 #define __PEOPLE_TRACKING_NODE__
 
 #include <string>
+#include <map>
 #include <boost/thread/mutex.hpp>
 
 // ros stuff
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <tf/tf.h>
 #include <tf/transform_listener.h>
+#include <diagnostic_updater/diagnostic_updater.h>
 
 // people tracking stuff
 #include "tracker.h"
 #include "detector_particle.h"
+#include "tracker_bank.h"
+#include "worker_pool.h"
 #include "gaussian_vector.h"
 
 // messages
 #include <sensor_msgs/PointCloud.h>
 #include <people_msgs/PositionMeasurement.h>
+#include <people_msgs/PositionMeasurementArray.h>
 #include <message_filters/time_sequencer.h>
 #include <message_filters/subscriber.h>
 
@@ -75,12 +81,24 @@ public:
   /// callback for messages
   void callbackRcv(const people_msgs::PositionMeasurement::ConstPtr& message);
 
+  /// callback for arrays of messages
+  void callbackRcvArray(const people_msgs::PositionMeasurementArray::ConstPtr& array);
+
   /// callback for dropped messages
   void callbackDrop(const people_msgs::PositionMeasurement::ConstPtr& message);
 
-  /// tracker loop
+  /// process the measurements and publish the estimates until shutdown
   void spin();
 
+  /// predict the trackers and publish their estimates, at freq_
+  void publishEstimates(const ros::TimerEvent& event);
+
+  /// report the trackers and their particles
+  void trackerDiagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat);
+
+  /// predict one tracker of the current pass of spin() and take its estimate
+  void updateTracker(double time, unsigned int index);
+
 
 private:
 
@@ -91,6 +109,7 @@ private:
   ros::Publisher people_tracker_vis_pub_;
 
   ros::Subscriber people_meas_sub_;
+  ros::Subscriber people_meas_array_sub_;
 
   /// message sequencer
   message_filters::TimeSequencer<people_msgs::PositionMeasurement>*  message_sequencer_;
@@ -113,6 +132,51 @@ private:
   // Track only one person who the robot will follow.
   bool follow_one_person_;
 
+  // Type of the trackers, and the bounds of the KLD-sampling of particle trackers
+  std::string tracker_type_;
+  int num_particles_min_, num_particles_max_;
+  double kld_error_, kld_bin_pos_, kld_bin_vel_;
+
+  /// storage of all trackers of type kalman_bank, NULL for the other types
+  TrackerBank* bank_;
+
+  /// threads that predict the trackers in spin(), and the trackers of the current pass with their
+  /// estimates and qualities
+  int num_threads_;
+  WorkerPool* pool_;
+  std::vector<Tracker*> pass_trackers_;
+  std::vector<people_msgs::PositionMeasurement> pass_estimates_;
+  std::vector<double> pass_qualities_;
+
+  /// The estimates are published from a timer on their own queue, which spin() services, while
+  /// the measurements are processed on a spinner thread as they arrive.
+  ros::CallbackQueue output_queue_;
+  ros::Timer output_timer_;
+
+  /// the stamp of a measurement, and the time at which the node received it
+  struct Arrival
+  {
+    ros::Time stamp, received;
+  };
+
+  /// arrival of the first correction of every tracker since its last estimate
+  std::map<Tracker*, Arrival> unpublished_corrections_;
+
+  /// Latency of the estimates since the last diagnostics, from the stamp of the measurement,
+  /// which includes the transport and the queue of the spinner, and from its receipt, which
+  /// is the time spent in the node alone; and the delay of the timer
+  unsigned int latency_count_;
+  double stamp_latency_sum_, stamp_latency_max_;
+  double receipt_latency_sum_, receipt_latency_max_, output_delay_max_;
+
+  diagnostic_updater::Updater updater_;
+
+  /// create a tracker of the configured type
+  Tracker* createTracker(const std::string& name);
+
+  /// correct the trackers with an array of measurements, and start new ones
+  void processMeasurements(const people_msgs::PositionMeasurementArray& array, const ros::Time& received);
+
 
 }; // class
 
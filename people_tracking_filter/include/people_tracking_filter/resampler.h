@@ -0,0 +1,120 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <pdf/mcpdf.h>
+#include "fast_rng.h"
+#include <vector>
+
+namespace BFL
+{
+/// Systematic resampling of a particle set in place, when its effective sample size drops below
+/// a fraction of the number of particles. The particle values are gathered into a buffer that
+/// keeps its capacity, so a filter of constant size resamples without heap allocations.
+template <typename T>
+class Resampler
+{
+public:
+  /// Constructor
+  explicit Resampler(double fraction = 0.25)
+    : fraction_(fraction),
+      ess_(0)
+  {};
+
+  /// resample when the effective sample size drops below this fraction of the particles
+  void fractionSet(double fraction)
+  {
+    fraction_ = fraction;
+  };
+
+  double fractionGet() const
+  {
+    return fraction_;
+  };
+
+  /// effective sample size of the particles before the last update
+  double effectiveSampleSizeGet() const
+  {
+    return ess_;
+  };
+
+  /// Resample if needed, returns true if it did. The weights need not be normalized.
+  bool update(std::vector<WeightedSample<T> >& samples, FastRng& rng)
+  {
+    const unsigned int n = samples.size();
+    if (n == 0)
+      return false;
+
+    double total = 0, total_sq = 0;
+    for (unsigned int i = 0; i < n; i++)
+    {
+      double w = samples[i].WeightGet();
+      total += w;
+      total_sq += w * w;
+    }
+    if (!(total_sq > 0))
+      return false;
+    ess_ = total * total / total_sq;
+    if (ess_ >= fraction_ * n)
+      return false;
+
+    // one random offset for n evenly spaced pointers into the cumulative weights
+    values_.resize(n);
+    const double step = total / n;
+    double target = rng.uniform() * step, cumulative = samples[0].WeightGet();
+    unsigned int j = 0;
+    for (unsigned int i = 0; i < n; i++, target += step)
+    {
+      while (target > cumulative && j + 1 < n)
+        cumulative += samples[++j].WeightGet();
+      values_[i] = samples[j].ValueGet();
+    }
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+      samples[i].ValueSet(values_[i]);
+      samples[i].WeightSet(1.0 / n);
+    }
+    return true;
+  };
+
+private:
+  double fraction_, ess_;
+  std::vector<T> values_;
+};
+
+} // end namespace
+#endif
@@ -64,6 +64,12 @@ public:
     dt_ = dt;
   };
 
+  // set the generator of the noise
+  void SetRng(FastRng* rng)
+  {
+    noise_.SetRng(rng);
+  };
+
   // Redefining pure virtual methods
   virtual bool SampleFrom(BFL::Sample<StatePosVel>& one_sample, int method, void *args) const;
   virtual StatePosVel ExpectedValueGet() const; // not applicable
@@ -103,6 +109,12 @@ public:
     ((SysPdfPosVel*)SystemPdfGet())->SetDt(dt);
   };
 
+  // set the generator of the noise
+  void SetRng(FastRng* rng)
+  {
+    ((SysPdfPosVel*)SystemPdfGet())->SetRng(rng);
+  };
+
 }; // class
 
 
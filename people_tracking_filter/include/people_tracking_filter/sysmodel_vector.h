@@ -63,6 +63,12 @@ public:
     dt_ = dt;
   };
 
+  // set the generator of the noise
+  void SetRng(FastRng* rng)
+  {
+    noise_.SetRng(rng);
+  };
+
   // Redefining pure virtual methods
   virtual bool SampleFrom(BFL::Sample<tf::Vector3>& one_sample, int method, void *args) const;
   virtual tf::Vector3 ExpectedValueGet() const; // not applicable
@@ -102,6 +108,12 @@ public:
     ((SysPdfVector*)SystemPdfGet())->SetDt(dt);
   };
 
+  // set the generator of the noise
+  void SetRng(FastRng* rng)
+  {
+    ((SysPdfVector*)SystemPdfGet())->SetRng(rng);
+  };
+
 }; // class
 
 
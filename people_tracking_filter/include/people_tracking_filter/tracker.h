@@ -40,6 +40,7 @@
 #include "state_pos_vel.h"
 #include <people_msgs/PositionMeasurement.h>
 #include <wrappers/matrix/matrix_wrapper.h>
+#include <boost/thread/mutex.hpp>
 #include <string>
 
 
@@ -85,8 +86,15 @@ public:
   virtual void getEstimate(BFL::StatePosVel& est) const = 0;
   virtual void getEstimate(people_msgs::PositionMeasurement& est) const = 0;
 
+  /// return the lock that serializes the updates of the tracker from several threads
+  boost::mutex& getMutex() const
+  {
+    return mutex_;
+  };
+
 private:
   std::string name_;
+  mutable boost::mutex mutex_;
 
 }; // class
 
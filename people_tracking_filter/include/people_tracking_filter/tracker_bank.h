@@ -0,0 +1,163 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef __TRACKER_BANK__
+#define __TRACKER_BANK__
+
+#include "tracker.h"
+#include "state_pos_vel.h"
+
+// TF
+#include <tf/tf.h>
+
+#include <vector>
+
+namespace estimation
+{
+
+class TrackerBankView;
+
+/// Constant velocity Kalman filters of TrackerKalmanFixed for many people, with every state and
+/// covariance entry stored as one array over the trackers. updatePrediction() predicts all
+/// trackers to a common time in one pass of branch free loops, which the compiler vectorizes, and
+/// updateCorrection() applies a batch of measurements. Every tracker is a TrackerBankView, which
+/// keeps the Tracker interface.
+class TrackerBank
+{
+public:
+  /// one measurement of one tracker
+  struct Correction
+  {
+    unsigned int slot;
+    double meas[3];
+    double cov[3][3];
+  };
+
+  /// constructor, with the system noise of all trackers
+  TrackerBank(const BFL::StatePosVel& sysnoise);
+
+  /// destructor
+  ~TrackerBank();
+
+  /// create a tracker in this bank, the bank has to outlive the tracker
+  TrackerBankView* createTracker(const std::string& name);
+
+  /// predict all initialized trackers that are behind time up to time
+  void updatePrediction(const double time);
+
+  /// apply one measurement per correction, returns the number of corrections that failed
+  unsigned int updateCorrection(const std::vector<Correction>& corrections);
+
+  /// return the number of trackers
+  unsigned int size() const
+  {
+    return time_.size() - free_.size();
+  };
+
+private:
+  friend class TrackerBankView;
+
+  // state [pos, vel], and the covariance in 3x3 blocks [A B; B' C] with the symmetric A and C
+  // stored as upper triangles
+  std::vector<double> mu_[6], a_[6], b_[9], c_[6];
+  std::vector<double> time_, init_time_, quality_;
+  // 1 for initialized trackers, 0 for the others and free slots
+  std::vector<double> live_;
+  // per tracker step and damping of the last prediction
+  std::vector<double> dt_, damping_;
+  std::vector<unsigned int> free_;
+  double sys_var_[6];
+
+  unsigned int allocate();
+  void release(unsigned int slot);
+  void gather(unsigned int slot, double mu[6], double sigma[6][6]) const;
+  void scatter(unsigned int slot, const double mu[6], const double sigma[6][6]);
+  void initialize(unsigned int slot, const BFL::StatePosVel& mu, const BFL::StatePosVel& sigma, const double time);
+  bool updatePrediction(unsigned int slot, const double time);
+  bool updateCorrection(unsigned int slot, const double meas[3], const double cov[3][3]);
+
+}; // class
+
+
+
+/// A tracker whose state lives in a TrackerBank
+class TrackerBankView: public Tracker
+{
+public:
+  /// destructor, frees the slot of the tracker in the bank
+  virtual ~TrackerBankView();
+
+  /// initialize tracker
+  virtual void initialize(const BFL::StatePosVel& mu, const BFL::StatePosVel& sigma, const double time);
+
+  /// return if tracker was initialized
+  virtual bool isInitialized() const;
+
+  /// return measure for tracker quality: 0=bad 1=good
+  virtual double getQuality() const;
+
+  /// return the lifetime of the tracker
+  virtual double getLifetime() const;
+
+  /// return the time of the tracker
+  virtual double getTime() const;
+
+  /// update tracker
+  virtual bool updatePrediction(const double time);
+  virtual bool updateCorrection(const tf::Vector3& meas,
+                                const MatrixWrapper::SymmetricMatrix& cov);
+
+  /// get filter posterior
+  virtual void getEstimate(BFL::StatePosVel& est) const;
+  virtual void getEstimate(people_msgs::PositionMeasurement& est) const;
+
+  /// return the slot of the tracker in its bank, for batched corrections
+  unsigned int getSlot() const
+  {
+    return slot_;
+  };
+
+private:
+  friend class TrackerBank;
+
+  TrackerBankView(const std::string& name, TrackerBank& bank, unsigned int slot);
+
+  TrackerBank& bank_;
+  unsigned int slot_;
+
+}; // class
+
+}; // namespace
+
+#endif
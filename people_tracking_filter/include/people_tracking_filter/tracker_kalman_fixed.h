@@ -0,0 +1,120 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef __TRACKER_KALMAN_FIXED__
+#define __TRACKER_KALMAN_FIXED__
+
+#include "tracker.h"
+#include "state_pos_vel.h"
+
+// TF
+#include <tf/tf.h>
+
+namespace estimation
+{
+
+/// Kalman filter with the constant velocity models of TrackerKalman, in closed form on fixed size
+/// arrays instead of BFL matrices. It gives the same estimates and quality, and its prediction,
+/// correction and estimates do not allocate.
+class TrackerKalmanFixed: public Tracker
+{
+public:
+  /// constructor
+  TrackerKalmanFixed(const std::string& name, const BFL::StatePosVel& sysnoise);
+
+  /// destructor
+  virtual ~TrackerKalmanFixed();
+
+  /// initialize tracker
+  virtual void initialize(const BFL::StatePosVel& mu, const BFL::StatePosVel& sigma, const double time);
+
+  /// return if tracker was initialized
+  virtual bool isInitialized() const
+  {
+    return tracker_initialized_;
+  };
+
+  /// return measure for tracker quality: 0=bad 1=good
+  virtual double getQuality() const
+  {
+    return quality_;
+  };
+
+  /// return the lifetime of the tracker
+  virtual double getLifetime() const;
+
+  /// return the time of the tracker
+  virtual double getTime() const;
+
+  /// update tracker
+  virtual bool updatePrediction(const double time);
+  virtual bool updateCorrection(const tf::Vector3& meas,
+                                const MatrixWrapper::SymmetricMatrix& cov);
+
+  /// get filter posterior
+  virtual void getEstimate(BFL::StatePosVel& est) const;
+  virtual void getEstimate(people_msgs::PositionMeasurement& est) const;
+
+  /// damping of the velocity per prediction, as in TrackerKalman
+  static const double DAMPING_VELOCITY;
+
+  /// Predict a state and covariance dt seconds ahead, with the system noise variances per second
+  /// squared. Shared with TrackerBank.
+  static void predict(double mu[6], double sigma[6][6], const double sys_var[6], double dt);
+
+  /// Correct a state and covariance with a position measurement, returns false if the innovation
+  /// covariance is not positive definite. Shared with TrackerBank.
+  static bool correct(double mu[6], double sigma[6][6], const double meas[3], const double cov[3][3]);
+
+  /// quality of a covariance: 0=bad 1=good
+  static double quality(const double sigma[6][6]);
+
+
+private:
+  // state [pos, vel] and its covariance
+  double mu_[6];
+  double sigma_[6][6];
+  // variance of the system noise per second squared
+  double sys_var_[6];
+
+  // vars
+  bool tracker_initialized_;
+  double init_time_, filter_time_, quality_;
+
+
+}; // class
+
+}; // namespace
+
+#endif
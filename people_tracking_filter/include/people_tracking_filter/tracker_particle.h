@@ -45,6 +45,7 @@
 #include "mcpdf_pos_vel.h"
 #include "sysmodel_pos_vel.h"
 #include "measmodel_pos.h"
+#include "fast_rng.h"
 
 // TF
 #include <tf/tf.h>
@@ -97,6 +98,9 @@ public:
   virtual void getEstimate(BFL::StatePosVel& est) const;
   virtual void getEstimate(people_msgs::PositionMeasurement& est) const;
 
+  /// get the standard deviation of the filter posterior
+  void getSpread(BFL::StatePosVel& sigma) const;
+
   // get evenly spaced particle cloud
   void getParticleCloud(const tf::Vector3& step, double threshold, sensor_msgs::PointCloud& cloud) const;
 
@@ -104,12 +108,26 @@ public:
   MatrixWrapper::Matrix getHistogramPos(const tf::Vector3& min, const tf::Vector3& max, const tf::Vector3& step) const;
   MatrixWrapper::Matrix getHistogramVel(const tf::Vector3& min, const tf::Vector3& max, const tf::Vector3& step) const;
 
+  /// restart the random numbers, which are seeded from the name of the tracker, for reproducible runs
+  void seed(uint64_t seed)
+  {
+    rng_.seed(seed);
+  };
+
+  /// resample when the effective sample size drops below this fraction of the particles
+  void setResampleFraction(double fraction)
+  {
+    resampler_.fractionSet(fraction);
+  };
+
 private:
   // pdf / model / filter
   BFL::MCPdfPosVel                                          prior_;
   BFL::BootstrapFilter<BFL::StatePosVel, tf::Vector3>*      filter_;
   BFL::SysModelPosVel                                       sys_model_;
   BFL::MeasModelPos                                         meas_model_;
+  BFL::FastRng                                              rng_;
+  BFL::Resampler<BFL::StatePosVel>                          resampler_;
 
   // vars
   bool tracker_initialized_;
@@ -0,0 +1,180 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef __TRACKER_PARTICLE_SOA__
+#define __TRACKER_PARTICLE_SOA__
+
+#include "tracker.h"
+#include "state_pos_vel.h"
+#include "fast_rng.h"
+
+#include <cstring>
+#include <vector>
+
+namespace estimation
+{
+class TrackerParticleSoATest;
+
+/// Particle filter with the models of TrackerParticle, with its particles stored as one float
+/// array per state dimension. Prediction, measurement likelihood and normalization are branch
+/// free loops over these arrays, which the compiler vectorizes, instead of virtual calls into
+/// BFL per particle.
+class TrackerParticleSoA: public Tracker
+{
+public:
+  /// constructor
+  TrackerParticleSoA(const std::string& name, unsigned int num_particles, const BFL::StatePosVel& sysnoise);
+
+  /// destructor
+  virtual ~TrackerParticleSoA();
+
+  /// initialize tracker
+  virtual void initialize(const BFL::StatePosVel& mu, const BFL::StatePosVel& sigma, const double time);
+
+  /// return if tracker was initialized
+  virtual bool isInitialized() const
+  {
+    return tracker_initialized_;
+  };
+
+  /// return measure for tracker quality: 0=bad 1=good
+  virtual double getQuality() const
+  {
+    return quality_;
+  };
+
+  /// return the lifetime of the tracker
+  virtual double getLifetime() const;
+
+  /// return the time of the tracker
+  virtual double getTime() const;
+
+  /// update tracker
+  virtual bool updatePrediction(const double time);
+  virtual bool updateCorrection(const tf::Vector3& meas,
+                                const MatrixWrapper::SymmetricMatrix& cov);
+
+  /// get filter posterior
+  virtual void getEstimate(BFL::StatePosVel& est) const;
+  virtual void getEstimate(people_msgs::PositionMeasurement& est) const;
+
+  /// get the standard deviation of the filter posterior
+  void getSpread(BFL::StatePosVel& sigma) const;
+
+  /// Adapt the number of particles by KLD-sampling, between min_particles and max_particles. Each
+  /// correction then draws particles until they approximate the posterior within kld_error with the
+  /// probability of the standard normal quantile kld_z, on bins of bin_pos [m] and bin_vel [m/s]
+  /// in the ground plane. The tracker starts with max_particles.
+  void setAdaptive(unsigned int min_particles, unsigned int max_particles, double kld_error = 0.05,
+                   double kld_z = 2.326, double bin_pos = 0.1, double bin_vel = 0.2);
+
+  /// return the current number of particles
+  unsigned int getNumParticles() const
+  {
+    return num_particles_;
+  };
+
+  /// restart the random numbers, which are seeded from the name of the tracker, for reproducible runs
+  void seed(uint64_t seed)
+  {
+    rng_.seed(seed);
+  };
+
+  /// resample when the effective sample size drops below this fraction of the particles
+  void setResampleFraction(double fraction)
+  {
+    resample_fraction_ = fraction;
+  };
+
+  /// exp(x) for x in [-87, 0], where the result is still a normal float, without branches, so that
+  /// the loops calling it vectorize. x / ln 2 rounded to the nearest integer goes into the exponent
+  /// bits, and exp of the rest, reduced with a two part ln 2 to within ln 2 / 2, is a degree 7
+  /// polynomial. The relative error is below 2e-6.
+  static inline float expNonPositive(float x)
+  {
+    int i = (int)(x * 1.44269504f - 0.5f);  // x is not positive, truncating rounds to the nearest
+    float f = (x - i * 0.693145751953125f) - i * 1.42860677e-6f;
+    float p = 1.0f + f * (1.0f + f * (1.0f / 2 + f * (1.0f / 6 + f * (1.0f / 24 + f * (1.0f / 120
+              + f * (1.0f / 720 + f * (1.0f / 5040)))))));
+    int bits = (i + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+  };
+
+private:
+  friend class TrackerParticleSoATest;
+
+  /// one array per state dimension
+  struct Particles
+  {
+    std::vector<float> pos[3], vel[3];
+
+    void resize(unsigned int n);
+    void swap(Particles& other);
+  };
+
+  Particles particles_, resampled_;
+  std::vector<float> weights_, loglik_, noise_, cumulative_;
+
+  BFL::StatePosVel sys_sigma_;
+  tf::Vector3 meas_sigma_;
+  BFL::FastRng rng_;
+
+  // vars
+  bool tracker_initialized_;
+  double init_time_, filter_time_, quality_, resample_fraction_;
+  unsigned int num_particles_;
+
+  // KLD-sampling, with an open addressing set of the occupied bins that is cleared by advancing
+  // its generation
+  bool adaptive_;
+  unsigned int min_particles_, max_particles_;
+  double kld_error_, kld_z_;
+  float bin_pos_, bin_vel_;
+  std::vector<uint64_t> bin_keys_;
+  std::vector<uint32_t> bin_generations_;
+  uint32_t bin_generation_;
+
+  void allocate(unsigned int max_particles);
+  void resample();
+  void resampleKld();
+  bool insertBin(unsigned int particle);
+  unsigned int kldParticles(unsigned int bins) const;
+
+}; // class
+
+}; // namespace
+
+#endif
@@ -39,6 +39,7 @@
 
 #include <pdf/pdf.h>
 #include <tf/tf.h>
+#include "fast_rng.h"
 
 
 
@@ -50,6 +51,7 @@ class UniformVector: public Pdf<tf::Vector3>
 private:
   tf::Vector3 mu_, size_;
   double probability_;
+  FastRng* rng_;
 
 public:
   /// Constructor
@@ -61,6 +63,12 @@ public:
   /// output stream for UniformVector
   friend std::ostream& operator<< (std::ostream& os, const UniformVector& g);
 
+  /// draw samples from rng, or from the generator of the calling thread if it is NULL
+  void SetRng(FastRng* rng)
+  {
+    rng_ = rng;
+  };
+
   // Redefinition of pure virtuals
   virtual UniformVector* Clone() const;
 
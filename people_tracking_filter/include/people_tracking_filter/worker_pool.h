@@ -0,0 +1,94 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef __WORKER_POOL__
+#define __WORKER_POOL__
+
+#include <boost/function.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace estimation
+{
+
+/// A fixed set of threads that runs a job over the indices 0..count-1, e.g. one per tracker. Every
+/// thread starts on its own contiguous share of the indices, and when that runs out it steals the
+/// back half of the largest share that is left. This balances jobs of very different cost, like
+/// particle trackers of adaptive size, without a shared queue.
+class WorkerPool
+{
+public:
+  typedef boost::function<void (unsigned int)> Job;
+
+  /// constructor, with the number of threads including the one that calls run()
+  WorkerPool(unsigned int threads);
+
+  /// destructor, stops the threads
+  ~WorkerPool();
+
+  /// run the job for all indices below count, and return when all are done
+  void run(unsigned int count, const Job& job);
+
+  /// return the number of threads including the one that calls run()
+  unsigned int size() const
+  {
+    return threads_;
+  };
+
+private:
+  unsigned int threads_;
+  boost::thread_group workers_;
+
+  // the share of every thread is [begin, end)
+  boost::scoped_array<boost::mutex> share_mutex_;
+  boost::scoped_array<unsigned int> begin_, end_;
+
+  // the job of the current run, and the workers that did not finish it yet
+  boost::mutex run_mutex_;
+  boost::condition start_cond_, done_cond_;
+  const Job* job_;
+  unsigned long generation_;
+  unsigned int running_;
+
+  void workerLoop(unsigned int thread);
+  void work(unsigned int thread);
+  bool take(unsigned int thread, unsigned int& index);
+
+}; // class
+
+}; // namespace
+
+#endif
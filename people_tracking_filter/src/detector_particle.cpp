@@ -57,7 +57,9 @@ DetectorParticle::DetectorParticle(unsigned int num_particles):
   meas_model_(tf::Vector3(0.1, 0.1, 0.1)),
   detector_initialized_(false),
   num_particles_(num_particles)
-{}
+{
+  sys_model_.SetRng(&rng_);
+}
 
 
 
@@ -75,10 +77,14 @@ void DetectorParticle::initialize(const tf::Vector3& mu, const tf::Vector3& size
        << size << " around " << mu << endl;
 
   UniformVector uniform_vector(mu, size);
+  uniform_vector.SetRng(&rng_);
   vector<Sample<tf::Vector3> > prior_samples(num_particles_);
   uniform_vector.SampleFrom(prior_samples, num_particles_, CHOLESKY, NULL);
   prior_.ListOfSamplesSet(prior_samples);
-  filter_ = new BootstrapFilter<tf::Vector3, tf::Vector3>(&prior_, &prior_, 0, num_particles_ / 4.0);
+  // BFL only weights the particles, they are resampled in place after each correction. BFL asserts
+  // that period and threshold are not both 0, and resamples below an effective sample size of 1.0,
+  // which never happens.
+  filter_ = new BootstrapFilter<tf::Vector3, tf::Vector3>(&prior_, &prior_, 0, 1.0);
 
   // detector initialized
   detector_initialized_ = true;
@@ -118,6 +124,7 @@ bool DetectorParticle::updateCorrection(const tf::Vector3&  meas, const MatrixWr
   // update filter
   bool res = filter_->Update(&meas_model_, meas);
   if (!res) quality_ = 0;
+  else ((MCPdfVector*)(filter_->PostGet()))->resample(resampler_, rng_);
 
   return res;
 }
@@ -0,0 +1,227 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#include "people_tracking_filter/fast_rng.h"
+
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace BFL
+{
+// 2^-24, the spacing of the uniform variates made from the upper 24 bits of a draw
+static const float UNIT = 1.0f / 16777216;
+
+static inline uint64_t splitMix(uint64_t& x)
+{
+  uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// log(u) for u in (0, 1]. The exponent bits give the power of two, and the log of the mantissa m
+// in [1, 2) is the series in t = (m - 1) / (m + 1) <= 1/3, with an error below 1e-6.
+static inline float logUnit(float u)
+{
+  int32_t bits;
+  memcpy(&bits, &u, sizeof(bits));
+  int32_t exponent = ((bits >> 23) & 0xff) - 127;
+  bits = (bits & 0x7fffff) | 0x3f800000;
+  float m;
+  memcpy(&m, &bits, sizeof(m));
+  float t = (m - 1) / (m + 1), t2 = t * t;
+  return exponent * 0.693147181f
+         + 2 * t * (1 + t2 * (1.0f / 3 + t2 * (1.0f / 5 + t2 * (1.0f / 7 + t2 * (1.0f / 9)))));
+}
+
+// sin and cos of 2 pi a for a in [-1/2, 1/2). Taylor series of the half angle, which stays within
+// [-pi/2, pi/2], and the double angle formulas, with an error below 1e-7.
+static inline void sinCosTurn(float a, float& s, float& c)
+{
+  float h = 3.14159265f * a, h2 = h * h;
+  float sh = h * (1 - h2 / 6 * (1 - h2 / 20 * (1 - h2 / 42 * (1 - h2 / 72 * (1 - h2 / 110)))));
+  float ch = 1 - h2 / 2 * (1 - h2 / 12 * (1 - h2 / 30 * (1 - h2 / 56 * (1 - h2 / 90 * (1 - h2 / 132)))));
+  s = 2 * sh * ch;
+  c = 1 - 2 * sh * sh;
+}
+
+
+FastRng::FastRng(uint64_t seed)
+{
+  this->seed(seed);
+}
+
+
+void FastRng::seed(uint64_t seed)
+{
+  for (unsigned int l = 0; l < LANES; l++)
+    for (unsigned int k = 0; k < 4; k += 2)
+    {
+      uint64_t z = splitMix(seed);
+      state_[k][l] = (uint32_t)z;
+      state_[k + 1][l] = (uint32_t)(z >> 32);
+    }
+  next_normal_ = BLOCK;
+  next_uniform_ = BLOCK;
+}
+
+
+uint64_t FastRng::seedFrom(const std::string& key)
+{
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < key.size(); i++)
+    hash = (hash ^ (unsigned char)key[i]) * 0x100000001b3ULL;
+  return hash;
+}
+
+
+// n must be a multiple of LANES. The inner loop steps all streams at once.
+void FastRng::generate(uint32_t* __restrict__ out, unsigned int n)
+{
+  uint32_t s0[LANES], s1[LANES], s2[LANES], s3[LANES];
+  for (unsigned int l = 0; l < LANES; l++)
+  {
+    s0[l] = state_[0][l];
+    s1[l] = state_[1][l];
+    s2[l] = state_[2][l];
+    s3[l] = state_[3][l];
+  }
+
+  for (unsigned int i = 0; i < n; i += LANES, out += LANES)
+    for (unsigned int l = 0; l < LANES; l++)
+    {
+      out[l] = s0[l] + s3[l];
+      uint32_t t = s1[l] << 9;
+      s2[l] ^= s0[l];
+      s3[l] ^= s1[l];
+      s1[l] ^= s2[l];
+      s0[l] ^= s3[l];
+      s2[l] ^= t;
+      s3[l] = (s3[l] << 11) | (s3[l] >> 21);
+    }
+
+  for (unsigned int l = 0; l < LANES; l++)
+  {
+    state_[0][l] = s0[l];
+    state_[1][l] = s1[l];
+    state_[2][l] = s2[l];
+    state_[3][l] = s3[l];
+  }
+}
+
+
+// BLOCK normal variates by Box-Muller, each pair of uniforms gives two of them
+void FastRng::normalBlock(float* out)
+{
+  static const unsigned int HALF = BLOCK / 2;
+  generate(bits_, BLOCK);
+  const uint32_t* __restrict__ bits = bits_;
+  float* __restrict__ result = out;
+  for (unsigned int i = 0; i < HALF; i++)
+  {
+    float radius_u = ((bits[i] >> 8) + 1) * UNIT;           // (0, 1], the log stays finite
+    float angle_u = (bits[HALF + i] >> 8) * UNIT - 0.5f;    // [-1/2, 1/2)
+    float radius = std::sqrt(-2 * logUnit(radius_u));
+    float s, c;
+    sinCosTurn(angle_u, s, c);
+    result[i] = radius * c;
+    result[HALF + i] = radius * s;
+  }
+}
+
+
+void FastRng::uniformBlock(float* out)
+{
+  generate(bits_, BLOCK);
+  const uint32_t* __restrict__ bits = bits_;
+  float* __restrict__ result = out;
+  for (unsigned int i = 0; i < BLOCK; i++)
+    result[i] = (bits[i] >> 8) * UNIT;
+}
+
+
+void FastRng::refillNormal()
+{
+  normalBlock(normal_);
+  next_normal_ = 0;
+}
+
+
+void FastRng::refillUniform()
+{
+  uniformBlock(uniform_);
+  next_uniform_ = 0;
+}
+
+
+// Whole blocks go straight into the buffer, the rest comes from the buffered block
+void FastRng::fillNormal(float* out, unsigned int n)
+{
+  unsigned int i = std::min(n, BLOCK - next_normal_);
+  memcpy(out, normal_ + next_normal_, i * sizeof(float));
+  next_normal_ += i;
+  for (; i + BLOCK <= n; i += BLOCK)
+    normalBlock(out + i);
+  for (; i < n; i++)
+    out[i] = normal();
+}
+
+
+void FastRng::fillUniform(float* out, unsigned int n)
+{
+  unsigned int i = std::min(n, BLOCK - next_uniform_);
+  memcpy(out, uniform_ + next_uniform_, i * sizeof(float));
+  next_uniform_ += i;
+  for (; i + BLOCK <= n; i += BLOCK)
+    uniformBlock(out + i);
+  for (; i < n; i++)
+    out[i] = uniform();
+}
+
+
+static boost::thread_specific_ptr<FastRng> thread_rng;
+
+FastRng& FastRng::threadDefault()
+{
+  if (!thread_rng.get())
+    thread_rng.reset(new FastRng());
+  return *thread_rng;
+}
+
+} // End namespace BFL
@@ -36,7 +36,6 @@
 
 
 #include "people_tracking_filter/gaussian_pos_vel.h"
-#include <wrappers/rng/rng.h>
 #include <cmath>
 #include <cassert>
 
@@ -49,7 +48,9 @@ GaussianPosVel::GaussianPosVel(const StatePosVel& mu, const StatePosVel& sigma)
     mu_(mu),
     sigma_(sigma),
     gauss_pos_(mu.pos_, sigma.pos_),
-    gauss_vel_(mu.vel_, sigma.vel_)
+    gauss_vel_(mu.vel_, sigma.vel_),
+    dt_(1.0),
+    rng_(NULL)
 {}
 
 
@@ -78,10 +79,21 @@ Probability GaussianPosVel::ProbabilityGet(const StatePosVel& input) const
 bool
 GaussianPosVel::SampleFrom(vector<Sample<StatePosVel> >& list_samples, const int num_samples, int method, void * args) const
 {
+  // all variates at once, the generator fills whole blocks faster than single draws
   list_samples.resize(num_samples);
-  vector<Sample<StatePosVel> >::iterator sample_it = list_samples.begin();
-  for (sample_it = list_samples.begin(); sample_it != list_samples.end(); sample_it++)
-    SampleFrom(*sample_it, method, args);
+  vector<float> noise(6 * num_samples);
+  if (num_samples > 0)
+    (rng_ ? *rng_ : FastRng::threadDefault()).fillNormal(&noise[0], noise.size());
+  for (int i = 0; i < num_samples; i++)
+  {
+    const float* n = &noise[6 * i];
+    list_samples[i].ValueSet(StatePosVel(Vector3(mu_.pos_[0] + sigma_.pos_[0] * dt_ * n[0],
+                                                 mu_.pos_[1] + sigma_.pos_[1] * dt_ * n[1],
+                                                 mu_.pos_[2] + sigma_.pos_[2] * dt_ * n[2]),
+                                         Vector3(mu_.vel_[0] + sigma_.vel_[0] * dt_ * n[3],
+                                                 mu_.vel_[1] + sigma_.vel_[1] * dt_ * n[4],
+                                                 mu_.vel_[2] + sigma_.vel_[2] * dt_ * n[5])));
+  }
 
   return true;
 }
@@ -90,12 +102,13 @@ GaussianPosVel::SampleFrom(vector<Sample<StatePosVel> >& list_samples, const int
 bool
 GaussianPosVel::SampleFrom(Sample<StatePosVel>& one_sample, int method, void * args) const
 {
-  one_sample.ValueSet(StatePosVel(Vector3(rnorm(mu_.pos_[0], sigma_.pos_[0]*dt_),
-                                          rnorm(mu_.pos_[1], sigma_.pos_[1]*dt_),
-                                          rnorm(mu_.pos_[2], sigma_.pos_[2]*dt_)),
-                                  Vector3(rnorm(mu_.vel_[0], sigma_.vel_[0]*dt_),
-                                          rnorm(mu_.vel_[1], sigma_.vel_[1]*dt_),
-                                          rnorm(mu_.vel_[2], sigma_.vel_[2]*dt_))));
+  FastRng& rng = rng_ ? *rng_ : FastRng::threadDefault();
+  one_sample.ValueSet(StatePosVel(Vector3(mu_.pos_[0] + sigma_.pos_[0] * dt_ * rng.normal(),
+                                          mu_.pos_[1] + sigma_.pos_[1] * dt_ * rng.normal(),
+                                          mu_.pos_[2] + sigma_.pos_[2] * dt_ * rng.normal()),
+                                  Vector3(mu_.vel_[0] + sigma_.vel_[0] * dt_ * rng.normal(),
+                                          mu_.vel_[1] + sigma_.vel_[1] * dt_ * rng.normal(),
+                                          mu_.vel_[2] + sigma_.vel_[2] * dt_ * rng.normal())));
   return true;
 }
 
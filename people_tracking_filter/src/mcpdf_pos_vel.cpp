@@ -180,3 +180,13 @@ MCPdfPosVel::numParticlesGet() const
 }
 
 
+bool
+MCPdfPosVel::resample(Resampler<StatePosVel>& resampler, FastRng& rng)
+{
+  if (!resampler.update(_listOfSamples, rng))
+    return false;
+  CumPDFUpdate();
+  return true;
+}
+
+
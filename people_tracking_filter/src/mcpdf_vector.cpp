@@ -163,3 +163,13 @@ MCPdfVector::numParticlesGet() const
 }
 
 
+bool
+MCPdfVector::resample(Resampler<Vector3>& resampler, FastRng& rng)
+{
+  if (!resampler.update(_listOfSamples, rng))
+    return false;
+  CumPDFUpdate();
+  return true;
+}
+
+
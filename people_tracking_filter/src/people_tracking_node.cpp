@@ -36,10 +36,14 @@
 
 #include "people_tracking_filter/people_tracking_node.h"
 #include "people_tracking_filter/tracker_particle.h"
+#include "people_tracking_filter/tracker_particle_soa.h"
 #include "people_tracking_filter/tracker_kalman.h"
+#include "people_tracking_filter/tracker_kalman_fixed.h"
+#include "people_tracking_filter/tracker_bank.h"
 #include "people_tracking_filter/state_pos_vel.h"
 #include "people_tracking_filter/rgb.h"
 #include <people_msgs/PositionMeasurement.h>
+#include <boost/bind.hpp>
 
 
 using namespace std;
@@ -50,7 +54,6 @@ using namespace message_filters;
 static const double       sequencer_delay            = 0.8; //TODO: this is probably too big, it was 0.8
 static const unsigned int sequencer_internal_buffer  = 100;
 static const unsigned int sequencer_subscribe_buffer = 10;
-static const unsigned int num_particles_tracker      = 1000;
 static const double       tracker_init_dist          = 4.0;
 
 namespace estimation
@@ -59,7 +62,15 @@ namespace estimation
 PeopleTrackingNode::PeopleTrackingNode(ros::NodeHandle nh)
   : nh_(nh),
     robot_state_(),
-    tracker_counter_(0)
+    tracker_counter_(0),
+    bank_(NULL),
+    pool_(NULL),
+    latency_count_(0),
+    stamp_latency_sum_(0.0),
+    stamp_latency_max_(0.0),
+    receipt_latency_sum_(0.0),
+    receipt_latency_max_(0.0),
+    output_delay_max_(0.0)
 {
   // initialize
   meas_cloud_.points = vector<geometry_msgs::Point32>(1);
@@ -80,6 +91,45 @@ PeopleTrackingNode::PeopleTrackingNode(ros::NodeHandle nh)
   local_nh.param("sys_sigma_vel_y", sys_sigma_.vel_[1], 0.0);
   local_nh.param("sys_sigma_vel_z", sys_sigma_.vel_[2], 0.0);
   local_nh.param("follow_one_person", follow_one_person_, false);
+  local_nh.param("tracker_type", tracker_type_, string("kalman"));
+  local_nh.param("num_particles_min", num_particles_min_, 100);
+  local_nh.param("num_particles_max", num_particles_max_, 1000);
+  local_nh.param("kld_error", kld_error_, 0.05);
+  local_nh.param("kld_bin_pos", kld_bin_pos_, 0.1);
+  local_nh.param("kld_bin_vel", kld_bin_vel_, 0.2);
+  local_nh.param("num_threads", num_threads_, 0);
+  if (tracker_type_ != "kalman" && tracker_type_ != "kalman_fixed" && tracker_type_ != "kalman_bank"
+      && tracker_type_ != "particle")
+  {
+    ROS_WARN("Unknown tracker type %s, using kalman", tracker_type_.c_str());
+    tracker_type_ = "kalman";
+  }
+  if (num_particles_min_ <= 0 || num_particles_max_ < num_particles_min_)
+  {
+    ROS_WARN("Invalid particle bounds [%d, %d], using [100, 1000]", num_particles_min_, num_particles_max_);
+    num_particles_min_ = 100;
+    num_particles_max_ = 1000;
+  }
+  if (!(kld_error_ > 0 && kld_error_ < 1))
+  {
+    ROS_WARN("Invalid KLD error %f, using 0.05", kld_error_);
+    kld_error_ = 0.05;
+  }
+  if (!(kld_bin_pos_ > 0))
+  {
+    ROS_WARN("Invalid KLD position bin size %f, using 0.1", kld_bin_pos_);
+    kld_bin_pos_ = 0.1;
+  }
+  if (!(kld_bin_vel_ > 0))
+  {
+    ROS_WARN("Invalid KLD velocity bin size %f, using 0.2", kld_bin_vel_);
+    kld_bin_vel_ = 0.2;
+  }
+  if (tracker_type_ == "kalman_bank")
+    bank_ = new TrackerBank(sys_sigma_);
+  if (num_threads_ <= 0)
+    num_threads_ = max(1u, boost::thread::hardware_concurrency());
+  pool_ = new WorkerPool(num_threads_);
 
   // advertise filter output
   people_filter_pub_ = nh_.advertise<people_msgs::PositionMeasurement>("people_tracker_filter", 10);
@@ -88,9 +138,18 @@ PeopleTrackingNode::PeopleTrackingNode(ros::NodeHandle nh)
   people_filter_vis_pub_ = nh_.advertise<sensor_msgs::PointCloud>("people_tracker_filter_visualization", 10);
   people_tracker_vis_pub_ = nh_.advertise<sensor_msgs::PointCloud>("people_tracker_measurements_visualization", 10);
 
-  // register message sequencer
-  people_meas_sub_ = nh_.subscribe("people_tracker_measurements", 1, &PeopleTrackingNode::callbackRcv, this);
+  // register message sequencer, the detectors publish arrays of measurements, and single
+  // measurements have a topic of their own
+  people_meas_array_sub_ = nh_.subscribe("people_tracker_measurements", 1, &PeopleTrackingNode::callbackRcvArray, this);
+  people_meas_sub_ = nh_.subscribe("people_tracker_measurement_single", 1, &PeopleTrackingNode::callbackRcv, this);
+
+  updater_.setHardwareID("none");
+  updater_.add("People trackers", this, &PeopleTrackingNode::trackerDiagnostics);
 
+  // publish the estimates at a fixed rate
+  ros::NodeHandle output_nh(nh_);
+  output_nh.setCallbackQueue(&output_queue_);
+  output_timer_ = output_nh.createTimer(ros::Duration(1.0 / freq_), &PeopleTrackingNode::publishEstimates, this);
 }
 
 
@@ -100,66 +159,168 @@ PeopleTrackingNode::~PeopleTrackingNode()
   // delete sequencer
   delete message_sequencer_;
 
+  // stop the workers
+  delete pool_;
+
   // delete all trackers
   for (list<Tracker*>::iterator it = trackers_.begin(); it != trackers_.end(); it++)
     delete *it;
+
+  // the trackers are views onto the bank
+  delete bank_;
 };
 
 
 
 
-// callback for messages
+// callback for single messages, which take the way of an array of one
 void PeopleTrackingNode::callbackRcv(const people_msgs::PositionMeasurement::ConstPtr& message)
 {
-  ROS_DEBUG("Tracking node got a people position measurement (%f,%f,%f)",
-            message->pos.x, message->pos.y, message->pos.z);
-  // get measurement in fixed frame
-  Stamped<tf::Vector3> meas_rel, meas;
-  meas_rel.setData(
-    tf::Vector3(message->pos.x, message->pos.y, message->pos.z));
-  meas_rel.stamp_ = message->header.stamp;
-  meas_rel.frame_id_ = message->header.frame_id;
-  robot_state_.transformPoint(fixed_frame_, meas_rel, meas);
+  ros::Time received = ros::Time::now();
+  people_msgs::PositionMeasurementArray array;
+  array.header = message->header;
+  array.people.push_back(*message);
+  processMeasurements(array, received);
+}
+
+
+
+// callback for arrays of messages
+void PeopleTrackingNode::callbackRcvArray(const people_msgs::PositionMeasurementArray::ConstPtr& array)
+{
+  processMeasurements(*array, ros::Time::now());
+}
+
+
+
+// Transform the measurements of an array with one lookup per frame and stamp, which the detectors
+// share across an array, and associate and correct all of them under one lock. The latency of
+// the corrections counts both from the stamp of the measurement and from received, the entry
+// into the callback.
+void PeopleTrackingNode::processMeasurements(const people_msgs::PositionMeasurementArray& array,
+                                             const ros::Time& received)
+{
+  unsigned int n = array.people.size();
+  if (n == 0)
+    return;
+  ROS_DEBUG("Tracking node got %d people position measurements", n);
+
+  // get measurements in fixed frame
+  vector<Stamped<tf::Vector3> > meas(n);
+  vector<bool> valid(n, false);
+  StampedTransform transform;
+  bool transform_valid = false;
+  for (unsigned int i = 0; i < n; i++)
+  {
+    const people_msgs::PositionMeasurement& message = array.people[i];
+    if (i == 0 || message.header.frame_id != array.people[i - 1].header.frame_id
+        || message.header.stamp != array.people[i - 1].header.stamp)
+    {
+      try
+      {
+        robot_state_.lookupTransform(fixed_frame_, message.header.frame_id, message.header.stamp, transform);
+        transform_valid = true;
+      }
+      catch (tf::TransformException& ex)
+      {
+        ROS_WARN("Cannot transform people position measurements to %s: %s", fixed_frame_.c_str(), ex.what());
+        transform_valid = false;
+      }
+    }
+    if (!transform_valid)
+      continue;
+    meas[i].setData(transform * tf::Vector3(message.pos.x, message.pos.y, message.pos.z));
+    meas[i].stamp_ = message.header.stamp;
+    meas[i].frame_id_ = fixed_frame_;
+    valid[i] = true;
+  }
 
   // get measurement covariance
-  SymmetricMatrix cov(3);
-  for (unsigned int i = 0; i < 3; i++)
-    for (unsigned int j = 0; j < 3; j++)
-      cov(i + 1, j + 1) = message->covariance[3 * i + j];
+  vector<SymmetricMatrix> covs(n, SymmetricMatrix(3));
+  for (unsigned int k = 0; k < n; k++)
+    for (unsigned int i = 0; i < 3; i++)
+      for (unsigned int j = 0; j < 3; j++)
+        covs[k](i + 1, j + 1) = array.people[k].covariance[3 * i + j];
 
   // ----- LOCKED ------
   boost::mutex::scoped_lock lock(filter_mutex_);
 
-  // update tracker if matching tracker found
+  // update tracker if matching tracker found, the trackers of a bank in one batch
+  map<string, Tracker*> named;
   for (list<Tracker*>::iterator it = trackers_.begin(); it != trackers_.end(); it++)
-    if ((*it)->getName() == message->object_id)
+    named[(*it)->getName()] = *it;
+  vector<TrackerBank::Correction> bank_corrections;
+  for (unsigned int k = 0; k < n; k++)
+  {
+    const people_msgs::PositionMeasurement& message = array.people[k];
+    map<string, Tracker*>::iterator found = named.find(message.object_id);
+    if (!valid[k] || message.object_id == "" || found == named.end())
+      continue;
+
+    Tracker* tracker = found->second;
+    boost::mutex::scoped_lock tracker_lock(tracker->getMutex());
+    tracker->updatePrediction(message.header.stamp.toSec());
+    if (bank_)
     {
-      (*it)->updatePrediction(message->header.stamp.toSec());
-      (*it)->updateCorrection(meas, cov);
+      TrackerBank::Correction correction;
+      correction.slot = static_cast<TrackerBankView*>(tracker)->getSlot();
+      for (unsigned int i = 0; i < 3; i++)
+      {
+        correction.meas[i] = meas[k][i];
+        for (unsigned int j = 0; j < 3; j++)
+          correction.cov[i][j] = covs[k](i + 1, j + 1);
+      }
+      bank_corrections.push_back(correction);
     }
-  // check if reliable message with no name should be a new tracker
-  if (message->object_id == "" && message->reliability > reliability_threshold_)
+    else
+      tracker->updateCorrection(meas[k], covs[k]);
+    Arrival arrival;
+    arrival.stamp = message.header.stamp;
+    arrival.received = received;
+    unpublished_corrections_.insert(make_pair(tracker, arrival));
+  }
+  if (!bank_corrections.empty())
+    bank_->updateCorrection(bank_corrections);
+
+  // check if reliable messages with no name should be new trackers, away from the trackers as of
+  // the corrections above and the new ones
+  vector<tf::Vector3> positions;
+  bool positions_valid = false;
+  for (unsigned int k = 0; k < n; k++)
   {
+    const people_msgs::PositionMeasurement& message = array.people[k];
+    if (!valid[k] || message.object_id != "" || message.reliability <= reliability_threshold_)
+      continue;
+
+    if (!positions_valid)
+    {
+      StatePosVel est;
+      for (list<Tracker*>::iterator it = trackers_.begin(); it != trackers_.end(); it++)
+      {
+        boost::mutex::scoped_lock tracker_lock((*it)->getMutex());
+        (*it)->getEstimate(est);
+        positions.push_back(est.pos_);
+      }
+      positions_valid = true;
+    }
     double closest_tracker_dist = start_distance_min_;
-    StatePosVel est;
-    for (list<Tracker*>::iterator it = trackers_.begin(); it != trackers_.end(); it++)
+    for (unsigned int t = 0; t < positions.size(); t++)
     {
-      (*it)->getEstimate(est);
-      double dst = sqrt(pow(est.pos_[0] - meas[0], 2) + pow(est.pos_[1] - meas[1], 2));
+      double dst = sqrt(pow(positions[t][0] - meas[k][0], 2) + pow(positions[t][1] - meas[k][1], 2));
       if (dst < closest_tracker_dist)
         closest_tracker_dist = dst;
     }
     // initialize a new tracker
     if (follow_one_person_)
       cout << "Following one person" << endl;
-    if (message->initialization == 1 && ((!follow_one_person_ && (closest_tracker_dist >= start_distance_min_)) || (follow_one_person_ && trackers_.empty())))
+    if (message.initialization == 1 && ((!follow_one_person_ && (closest_tracker_dist >= start_distance_min_)) || (follow_one_person_ && trackers_.empty())))
     {
-      //if (closest_tracker_dist >= start_distance_min_ || message->initialization == 1){
-      //if (message->initialization == 1 && trackers_.empty()){
+      //if (closest_tracker_dist >= start_distance_min_ || message.initialization == 1){
+      //if (message.initialization == 1 && trackers_.empty()){
       ROS_INFO("Passed crazy conditional.");
       tf::Point pt;
-      tf::pointMsgToTF(message->pos, pt);
-      tf::Stamped<tf::Point> loc(pt, message->header.stamp, message->header.frame_id);
+      tf::pointMsgToTF(message.pos, pt);
+      tf::Stamped<tf::Point> loc(pt, message.header.stamp, message.header.frame_id);
       robot_state_.transformPoint("base_link", loc, loc);
       float cur_dist;
       if ((cur_dist = pow(loc[0], 2.0) + pow(loc[1], 2.0)) < tracker_init_dist)
@@ -167,15 +328,14 @@ void PeopleTrackingNode::callbackRcv(const people_msgs::PositionMeasurement::Con
 
         cout << "starting new tracker" << endl;
         stringstream tracker_name;
-        StatePosVel prior_sigma(tf::Vector3(sqrt(cov(1, 1)), sqrt(cov(
-                                              2, 2)), sqrt(cov(3, 3))), tf::Vector3(0.0000001, 0.0000001, 0.0000001));
+        StatePosVel prior_sigma(tf::Vector3(sqrt(covs[k](1, 1)), sqrt(covs[k](
+                                              2, 2)), sqrt(covs[k](3, 3))), tf::Vector3(0.0000001, 0.0000001, 0.0000001));
         tracker_name << "person " << tracker_counter_++;
-        Tracker* new_tracker = new TrackerKalman(tracker_name.str(),
-            sys_sigma_);
-        //Tracker* new_tracker = new TrackerParticle(tracker_name.str(), num_particles_tracker, sys_sigma_);
-        new_tracker->initialize(meas, prior_sigma,
-                                message->header.stamp.toSec());
+        Tracker* new_tracker = createTracker(tracker_name.str());
+        new_tracker->initialize(meas[k], prior_sigma,
+                                message.header.stamp.toSec());
         trackers_.push_back(new_tracker);
+        positions.push_back(meas[k]);
         ROS_INFO("Initialized new tracker %s", tracker_name.str().c_str());
       }
       else
@@ -188,16 +348,98 @@ void PeopleTrackingNode::callbackRcv(const people_msgs::PositionMeasurement::Con
   // ------ LOCKED ------
 
 
-  // visualize measurement
-  meas_cloud_.points[0].x = meas[0];
-  meas_cloud_.points[0].y = meas[1];
-  meas_cloud_.points[0].z = meas[2];
-  meas_cloud_.header.frame_id = meas.frame_id_;
+  // visualize measurements
+  meas_cloud_.points.clear();
+  for (unsigned int k = 0; k < n; k++)
+    if (valid[k])
+    {
+      geometry_msgs::Point32 point;
+      point.x = meas[k][0];
+      point.y = meas[k][1];
+      point.z = meas[k][2];
+      meas_cloud_.points.push_back(point);
+    }
+  meas_cloud_.header.frame_id = fixed_frame_;
   people_tracker_vis_pub_.publish(meas_cloud_);
 }
 
 
 
+// Particle trackers adapt their number of particles by KLD-sampling. The fixed size Kalman filter
+// gives the estimates of the BFL one without allocating.
+Tracker* PeopleTrackingNode::createTracker(const string& name)
+{
+  if (tracker_type_ == "particle")
+  {
+    TrackerParticleSoA* tracker = new TrackerParticleSoA(name, num_particles_max_, sys_sigma_);
+    tracker->setAdaptive(num_particles_min_, num_particles_max_, kld_error_, 2.326, kld_bin_pos_, kld_bin_vel_);
+    return tracker;
+  }
+  if (tracker_type_ == "kalman_fixed")
+    return new TrackerKalmanFixed(name, sys_sigma_);
+  if (bank_)
+    return bank_->createTracker(name);
+  return new TrackerKalman(name, sys_sigma_);
+}
+
+
+
+void PeopleTrackingNode::trackerDiagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat)
+{
+  boost::mutex::scoped_lock lock(filter_mutex_);
+
+  stat.summaryf(diagnostic_msgs::DiagnosticStatus::OK, "Tracking %d people", (int)trackers_.size());
+  stat.add("Tracker type", tracker_type_);
+  stat.add("Trackers", trackers_.size());
+  stat.add("Threads", pool_->size());
+
+  unsigned int total = 0;
+  for (list<Tracker*>::iterator it = trackers_.begin(); it != trackers_.end(); it++)
+  {
+    TrackerParticleSoA* particle = dynamic_cast<TrackerParticleSoA*>(*it);
+    if (particle)
+    {
+      boost::mutex::scoped_lock tracker_lock((*it)->getMutex());
+      stat.add((*it)->getName() + " particles", particle->getNumParticles());
+      total += particle->getNumParticles();
+    }
+  }
+  if (tracker_type_ == "particle")
+    stat.add("Particles", total);
+
+  // since the last report
+  stat.add("Measurement stamp to estimate latency mean [s]",
+           latency_count_ > 0 ? stamp_latency_sum_ / latency_count_ : 0.0);
+  stat.add("Measurement stamp to estimate latency max [s]", stamp_latency_max_);
+  stat.add("Receipt to estimate latency mean [s]",
+           latency_count_ > 0 ? receipt_latency_sum_ / latency_count_ : 0.0);
+  stat.add("Receipt to estimate latency max [s]", receipt_latency_max_);
+  stat.add("Output delay max [s]", output_delay_max_);
+  latency_count_ = 0;
+  stamp_latency_sum_ = 0.0;
+  stamp_latency_max_ = 0.0;
+  receipt_latency_sum_ = 0.0;
+  receipt_latency_max_ = 0.0;
+  output_delay_max_ = 0.0;
+}
+
+
+
+// runs on the workers of the pool
+void PeopleTrackingNode::updateTracker(double time, unsigned int index)
+{
+  Tracker* tracker = pass_trackers_[index];
+  boost::mutex::scoped_lock lock(tracker->getMutex());
+
+  // update prediction up to delayed time
+  tracker->updatePrediction(time);
+  tracker->getEstimate(pass_estimates_[index]);
+  pass_estimates_[index].header.frame_id = fixed_frame_;
+  pass_qualities_[index] = tracker->getQuality();
+}
+
+
+
 // callback for dropped messages
 void PeopleTrackingNode::callbackDrop(const people_msgs::PositionMeasurement::ConstPtr& message)
 {
@@ -209,72 +451,120 @@ void PeopleTrackingNode::callbackDrop(const people_msgs::PositionMeasurement::Co
 
 
 
-// filter loop
+// Measurements are processed on their own thread as they arrive, the estimates are published
+// from the output timer on this one
 void PeopleTrackingNode::spin()
 {
   ROS_INFO("People tracking manager started.");
 
+  ros::AsyncSpinner spinner(1);
+  spinner.start();
   while (ros::ok())
+    output_queue_.callAvailable(ros::WallDuration(0.1));
+  spinner.stop();
+};
+
+
+
+// filter loop
+void PeopleTrackingNode::publishEstimates(const ros::TimerEvent& event)
+{
+  output_delay_max_ = max(output_delay_max_, (event.current_real - event.current_expected).toSec());
+
+  // ------ LOCKED ------
+  boost::mutex::scoped_lock lock(filter_mutex_);
+
+  // predict all trackers of a bank in one pass, which leaves nothing to do for them in the loop
+  double prediction_time = ros::Time::now().toSec() - sequencer_delay;
+  if (bank_)
+    bank_->updatePrediction(prediction_time);
+
+  // The trackers are predicted in parallel, while measurements keep coming in. Only this loop
+  // deletes trackers, so the ones of the pass stay valid. The trackers of a bank share its
+  // arrays, which a new tracker may reallocate, so they are predicted under the lock.
+  pass_trackers_.assign(trackers_.begin(), trackers_.end());
+  map<Tracker*, Arrival> corrections;
+  corrections.swap(unpublished_corrections_);
+  if (!bank_)
+    lock.unlock();
+  pass_estimates_.resize(pass_trackers_.size());
+  pass_qualities_.resize(pass_trackers_.size());
+  pool_->run(pass_trackers_.size(), boost::bind(&PeopleTrackingNode::updateTracker, this, prediction_time, _1));
+  if (bank_)
+    lock.unlock();
+  // ------ LOCKED ------
+
+  // visualization variables
+  vector<geometry_msgs::Point32> filter_visualize(pass_trackers_.size());
+  vector<float> weights(pass_trackers_.size());
+  sensor_msgs::ChannelFloat32 channel;
+
+  // loop over trackers
+  vector<Tracker*> removed;
+  for (unsigned int i = 0; i < pass_trackers_.size(); i++)
   {
-    // ------ LOCKED ------
-    boost::mutex::scoped_lock lock(filter_mutex_);
+    // publish filter result
+    const people_msgs::PositionMeasurement& est_pos = pass_estimates_[i];
+    ROS_DEBUG("Publishing people tracker filter.");
+    people_filter_pub_.publish(est_pos);
+
+    // visualize filter result
+    filter_visualize[i].x = est_pos.pos.x;
+    filter_visualize[i].y = est_pos.pos.y;
+    filter_visualize[i].z = est_pos.pos.z;
+    weights[i] = *(float*) & (rgb[min(998, 999 - max(1, (int)trunc(pass_qualities_[i] * 999.0)))]);
+
+    // remove trackers that have zero quality
+    ROS_INFO("Quality of tracker %s = %f", pass_trackers_[i]->getName().c_str(), pass_qualities_[i]);
+    if (pass_qualities_[i] <= 0)
+      removed.push_back(pass_trackers_[i]);
+  }
 
-    // visualization variables
-    vector<geometry_msgs::Point32> filter_visualize(trackers_.size());
-    vector<float> weights(trackers_.size());
-    sensor_msgs::ChannelFloat32 channel;
+  // latency of the corrections that made it into this pass
+  ros::Time now = ros::Time::now();
+  for (map<Tracker*, Arrival>::const_iterator it = corrections.begin(); it != corrections.end(); it++)
+  {
+    double stamp_latency = (now - it->second.stamp).toSec();
+    double receipt_latency = (now - it->second.received).toSec();
+    latency_count_++;
+    stamp_latency_sum_ += stamp_latency;
+    stamp_latency_max_ = max(stamp_latency_max_, stamp_latency);
+    receipt_latency_sum_ += receipt_latency;
+    receipt_latency_max_ = max(receipt_latency_max_, receipt_latency);
+  }
 
-    // loop over trackers
-    unsigned int i = 0;
-    list<Tracker*>::iterator it = trackers_.begin();
-    while (it != trackers_.end())
+  if (!removed.empty())
+  {
+    // ------ LOCKED ------
+    lock.lock();
+    for (unsigned int i = 0; i < removed.size(); i++)
     {
-      // update prediction up to delayed time
-      (*it)->updatePrediction(ros::Time::now().toSec() - sequencer_delay);
-
-      // publish filter result
-      people_msgs::PositionMeasurement est_pos;
-      (*it)->getEstimate(est_pos);
-      est_pos.header.frame_id = fixed_frame_;
-
-      ROS_DEBUG("Publishing people tracker filter.");
-      people_filter_pub_.publish(est_pos);
-
-      // visualize filter result
-      filter_visualize[i].x = est_pos.pos.x;
-      filter_visualize[i].y = est_pos.pos.y;
-      filter_visualize[i].z = est_pos.pos.z;
-      weights[i] = *(float*) & (rgb[min(998, 999 - max(1, (int)trunc((*it)->getQuality() * 999.0)))]);
-
-      // remove trackers that have zero quality
-      ROS_INFO("Quality of tracker %s = %f", (*it)->getName().c_str(), (*it)->getQuality());
-      if ((*it)->getQuality() <= 0)
+      // a measurement may have corrected the tracker since the pass
       {
-        ROS_INFO("Removing tracker %s", (*it)->getName().c_str());
-        delete *it;
-        trackers_.erase(it++);
+        boost::mutex::scoped_lock tracker_lock(removed[i]->getMutex());
+        if (removed[i]->getQuality() > 0)
+          continue;
       }
-      else it++;
-      i++;
+      ROS_INFO("Removing tracker %s", removed[i]->getName().c_str());
+      trackers_.remove(removed[i]);
+      unpublished_corrections_.erase(removed[i]);
+      delete removed[i];
     }
     lock.unlock();
     // ------ LOCKED ------
+  }
 
 
-    // visualize all trackers
-    channel.name = "rgb";
-    channel.values = weights;
-    sensor_msgs::PointCloud  people_cloud;
-    people_cloud.channels.push_back(channel);
-    people_cloud.header.frame_id = fixed_frame_;
-    people_cloud.points  = filter_visualize;
-    people_filter_vis_pub_.publish(people_cloud);
-
-    // sleep
-    usleep(1e6 / freq_);
+  // visualize all trackers
+  channel.name = "rgb";
+  channel.values = weights;
+  sensor_msgs::PointCloud  people_cloud;
+  people_cloud.channels.push_back(channel);
+  people_cloud.header.frame_id = fixed_frame_;
+  people_cloud.points  = filter_visualize;
+  people_filter_vis_pub_.publish(people_cloud);
 
-    ros::spinOnce();
-  }
+  updater_.update();
 };
 
 
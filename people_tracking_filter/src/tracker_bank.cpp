@@ -0,0 +1,387 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#include "people_tracking_filter/tracker_bank.h"
+#include "people_tracking_filter/tracker_kalman_fixed.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace MatrixWrapper;
+using namespace BFL;
+using namespace tf;
+using namespace std;
+
+
+// index of entry (i, j) of a symmetric 3x3 block in its upper triangle
+static const unsigned int SYM[3][3] = {{0, 1, 2}, {1, 3, 4}, {2, 4, 5}};
+
+
+namespace estimation
+{
+// constructor
+TrackerBank::TrackerBank(const StatePosVel& sysnoise)
+{
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    sys_var_[i] = pow(sysnoise.pos_[i], 2);
+    sys_var_[i + 3] = pow(sysnoise.vel_[i], 2);
+  }
+}
+
+
+
+// destructor
+TrackerBank::~TrackerBank()
+{}
+
+
+
+TrackerBankView* TrackerBank::createTracker(const string& name)
+{
+  return new TrackerBankView(name, *this, allocate());
+}
+
+
+
+// reuse a free slot, or grow all arrays by one
+unsigned int TrackerBank::allocate()
+{
+  if (!free_.empty())
+  {
+    unsigned int slot = free_.back();
+    free_.pop_back();
+    return slot;
+  }
+
+  unsigned int n = time_.size() + 1;
+  for (unsigned int k = 0; k < 6; k++)
+  {
+    mu_[k].resize(n, 0.0);
+    a_[k].resize(n, 0.0);
+    c_[k].resize(n, 0.0);
+  }
+  for (unsigned int k = 0; k < 9; k++)
+    b_[k].resize(n, 0.0);
+  time_.resize(n, 0.0);
+  init_time_.resize(n, 0.0);
+  quality_.resize(n, 0.0);
+  live_.resize(n, 0.0);
+  dt_.resize(n, 0.0);
+  damping_.resize(n, 1.0);
+  return n - 1;
+}
+
+
+
+void TrackerBank::release(unsigned int slot)
+{
+  live_[slot] = 0;
+  quality_[slot] = 0;
+  free_.push_back(slot);
+}
+
+
+
+void TrackerBank::gather(unsigned int slot, double mu[6], double sigma[6][6]) const
+{
+  for (unsigned int i = 0; i < 6; i++)
+    mu[i] = mu_[i][slot];
+  for (unsigned int i = 0; i < 3; i++)
+    for (unsigned int j = 0; j < 3; j++)
+    {
+      sigma[i][j] = a_[SYM[i][j]][slot];
+      sigma[i][j + 3] = b_[3 * i + j][slot];
+      sigma[j + 3][i] = b_[3 * i + j][slot];
+      sigma[i + 3][j + 3] = c_[SYM[i][j]][slot];
+    }
+}
+
+
+
+void TrackerBank::scatter(unsigned int slot, const double mu[6], const double sigma[6][6])
+{
+  for (unsigned int i = 0; i < 6; i++)
+    mu_[i][slot] = mu[i];
+  for (unsigned int i = 0; i < 3; i++)
+    for (unsigned int j = 0; j < 3; j++)
+    {
+      a_[SYM[i][j]][slot] = sigma[i][j];
+      b_[3 * i + j][slot] = sigma[i][j + 3];
+      c_[SYM[i][j]][slot] = sigma[i + 3][j + 3];
+    }
+}
+
+
+
+void TrackerBank::initialize(unsigned int slot, const StatePosVel& mu, const StatePosVel& sigma, const double time)
+{
+  double mu_vec[6], sigma_mat[6][6];
+  for (unsigned int i = 0; i < 6; i++)
+    for (unsigned int j = 0; j < 6; j++)
+      sigma_mat[i][j] = 0;
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    mu_vec[i] = mu.pos_[i];
+    mu_vec[i + 3] = mu.vel_[i];
+    sigma_mat[i][i] = pow(sigma.pos_[i], 2);
+    sigma_mat[i + 3][i + 3] = pow(sigma.vel_[i], 2);
+  }
+  scatter(slot, mu_vec, sigma_mat);
+
+  live_[slot] = 1;
+  quality_[slot] = 1;
+  time_[slot] = time;
+  init_time_[slot] = time;
+}
+
+
+
+// Predict all trackers with the block formulas of TrackerKalmanFixed::predict(), one loop over the
+// trackers per covariance entry. Trackers that are not live or not behind get dt = 0 and no
+// damping, which leaves them as they are.
+void TrackerBank::updatePrediction(const double time)
+{
+  const unsigned int n = time_.size();
+  if (n == 0)
+    return;
+
+  const double d = TrackerKalmanFixed::DAMPING_VELOCITY;
+  double* __restrict__ t = &time_[0];
+  double* __restrict__ dt = &dt_[0];
+  double* __restrict__ damping = &damping_[0];
+  const double* __restrict__ live = &live_[0];
+  for (unsigned int s = 0; s < n; s++)
+  {
+    double step = std::max(time - t[s], 0.0) * live[s];
+    dt[s] = step;
+    damping[s] = step > 0 ? d : 1.0;
+    t[s] += step;
+  }
+
+  // A first, it needs B and C before their update
+  for (unsigned int i = 0; i < 3; i++)
+    for (unsigned int j = i; j < 3; j++)
+    {
+      double* __restrict__ a = &a_[SYM[i][j]][0];
+      const double* __restrict__ bij = &b_[3 * i + j][0];
+      const double* __restrict__ bji = &b_[3 * j + i][0];
+      const double* __restrict__ c = &c_[SYM[i][j]][0];
+      const double noise = i == j ? sys_var_[i] : 0.0;
+      for (unsigned int s = 0; s < n; s++)
+        a[s] += dt[s] * (bij[s] + bji[s]) + dt[s] * dt[s] * (c[s] + noise);
+    }
+
+  for (unsigned int i = 0; i < 3; i++)
+    for (unsigned int j = 0; j < 3; j++)
+    {
+      double* __restrict__ b = &b_[3 * i + j][0];
+      const double* __restrict__ c = &c_[SYM[i][j]][0];
+      for (unsigned int s = 0; s < n; s++)
+        b[s] = damping[s] * (b[s] + dt[s] * c[s]);
+    }
+
+  for (unsigned int i = 0; i < 3; i++)
+    for (unsigned int j = i; j < 3; j++)
+    {
+      double* __restrict__ c = &c_[SYM[i][j]][0];
+      const double noise = i == j ? sys_var_[i + 3] : 0.0;
+      for (unsigned int s = 0; s < n; s++)
+        c[s] = damping[s] * damping[s] * c[s] + dt[s] * dt[s] * noise;
+    }
+
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    double* __restrict__ pos = &mu_[i][0];
+    double* __restrict__ vel = &mu_[i + 3][0];
+    for (unsigned int s = 0; s < n; s++)
+    {
+      pos[s] += dt[s] * vel[s];
+      vel[s] *= damping[s];
+    }
+  }
+
+  // quality as in TrackerKalmanFixed::quality(), for the trackers that moved
+  double* __restrict__ quality = &quality_[0];
+  const double* __restrict__ a00 = &a_[SYM[0][0]][0];
+  const double* __restrict__ a11 = &a_[SYM[1][1]][0];
+  for (unsigned int s = 0; s < n; s++)
+  {
+    double q = std::max(1.0 - sqrt(std::max(a00[s], a11[s])) / 1.5, 0.0);
+    double old = quality[s];
+    quality[s] = dt[s] > 0 ? q : old;
+  }
+}
+
+
+
+unsigned int TrackerBank::updateCorrection(const vector<Correction>& corrections)
+{
+  unsigned int failed = 0;
+  for (unsigned int k = 0; k < corrections.size(); k++)
+    if (!updateCorrection(corrections[k].slot, corrections[k].meas, corrections[k].cov))
+      failed++;
+  return failed;
+}
+
+
+
+bool TrackerBank::updatePrediction(unsigned int slot, const double time)
+{
+  if (time > time_[slot])
+  {
+    double mu[6], sigma[6][6];
+    gather(slot, mu, sigma);
+    TrackerKalmanFixed::predict(mu, sigma, sys_var_, time - time_[slot]);
+    scatter(slot, mu, sigma);
+    time_[slot] = time;
+    quality_[slot] = TrackerKalmanFixed::quality(sigma);
+  }
+  return true;
+}
+
+
+
+bool TrackerBank::updateCorrection(unsigned int slot, const double meas[3], const double cov[3][3])
+{
+  double mu[6], sigma[6][6];
+  gather(slot, mu, sigma);
+  if (!TrackerKalmanFixed::correct(mu, sigma, meas, cov))
+  {
+    quality_[slot] = 0;
+    return false;
+  }
+  scatter(slot, mu, sigma);
+  quality_[slot] = TrackerKalmanFixed::quality(sigma);
+  return true;
+}
+
+
+
+// constructor
+TrackerBankView::TrackerBankView(const string& name, TrackerBank& bank, unsigned int slot):
+  Tracker(name),
+  bank_(bank),
+  slot_(slot)
+{}
+
+
+
+// destructor
+TrackerBankView::~TrackerBankView()
+{
+  bank_.release(slot_);
+}
+
+
+
+void TrackerBankView::initialize(const StatePosVel& mu, const StatePosVel& sigma, const double time)
+{
+  bank_.initialize(slot_, mu, sigma, time);
+}
+
+
+bool TrackerBankView::isInitialized() const
+{
+  return bank_.live_[slot_] > 0;
+}
+
+
+double TrackerBankView::getQuality() const
+{
+  return bank_.quality_[slot_];
+}
+
+
+bool TrackerBankView::updatePrediction(const double time)
+{
+  return bank_.updatePrediction(slot_, time);
+}
+
+
+bool TrackerBankView::updateCorrection(const tf::Vector3&  meas, const MatrixWrapper::SymmetricMatrix& cov)
+{
+  assert(cov.columns() == 3);
+
+  double meas_vec[3], cov_mat[3][3];
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    meas_vec[i] = meas[i];
+    for (unsigned int j = 0; j < 3; j++)
+      cov_mat[i][j] = cov(i + 1, j + 1);
+  }
+  return bank_.updateCorrection(slot_, meas_vec, cov_mat);
+}
+
+
+void TrackerBankView::getEstimate(StatePosVel& est) const
+{
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    est.pos_[i] = bank_.mu_[i][slot_];
+    est.vel_[i] = bank_.mu_[i + 3][slot_];
+  }
+}
+
+
+void TrackerBankView::getEstimate(people_msgs::PositionMeasurement& est) const
+{
+  est.pos.x = bank_.mu_[0][slot_];
+  est.pos.y = bank_.mu_[1][slot_];
+  est.pos.z = bank_.mu_[2][slot_];
+
+  est.header.stamp.fromSec(bank_.time_[slot_]);
+  est.object_id = getName();
+}
+
+
+double TrackerBankView::getLifetime() const
+{
+  if (isInitialized())
+    return bank_.time_[slot_] - bank_.init_time_[slot_];
+  else
+    return 0;
+}
+
+
+double TrackerBankView::getTime() const
+{
+  if (isInitialized())
+    return bank_.time_[slot_];
+  else
+    return 0;
+}
+
+}; // namespace
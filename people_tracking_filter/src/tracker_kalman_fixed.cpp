@@ -0,0 +1,276 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+#include "people_tracking_filter/tracker_kalman_fixed.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace MatrixWrapper;
+using namespace BFL;
+using namespace tf;
+using namespace std;
+
+
+namespace estimation
+{
+const double TrackerKalmanFixed::DAMPING_VELOCITY = 0.9;
+
+// constructor
+TrackerKalmanFixed::TrackerKalmanFixed(const string& name, const StatePosVel& sysnoise):
+  Tracker(name),
+  tracker_initialized_(false),
+  init_time_(0),
+  filter_time_(0),
+  quality_(0)
+{
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    sys_var_[i] = pow(sysnoise.pos_[i], 2);
+    sys_var_[i + 3] = pow(sysnoise.vel_[i], 2);
+  }
+};
+
+
+
+// destructor
+TrackerKalmanFixed::~TrackerKalmanFixed()
+{};
+
+
+
+// initialize prior density of filter
+void TrackerKalmanFixed::initialize(const StatePosVel& mu, const StatePosVel& sigma, const double time)
+{
+  for (unsigned int i = 0; i < 6; i++)
+    for (unsigned int j = 0; j < 6; j++)
+      sigma_[i][j] = 0;
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    mu_[i] = mu.pos_[i];
+    mu_[i + 3] = mu.vel_[i];
+    sigma_[i][i] = pow(sigma.pos_[i], 2);
+    sigma_[i + 3][i + 3] = pow(sigma.vel_[i], 2);
+  }
+
+  // tracker initialized
+  tracker_initialized_ = true;
+  quality_ = 1;
+  filter_time_ = time;
+  init_time_ = time;
+}
+
+
+
+
+// update filter prediction
+bool TrackerKalmanFixed::updatePrediction(const double time)
+{
+  if (time > filter_time_)
+  {
+    predict(mu_, sigma_, sys_var_, time - filter_time_);
+    filter_time_ = time;
+    quality_ = quality(sigma_);
+  }
+  return true;
+};
+
+
+
+// update filter correction
+bool TrackerKalmanFixed::updateCorrection(const tf::Vector3&  meas, const MatrixWrapper::SymmetricMatrix& cov)
+{
+  assert(cov.columns() == 3);
+
+  double meas_vec[3], cov_mat[3][3];
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    meas_vec[i] = meas[i];
+    for (unsigned int j = 0; j < 3; j++)
+      cov_mat[i][j] = cov(i + 1, j + 1);
+  }
+
+  if (!correct(mu_, sigma_, meas_vec, cov_mat))
+  {
+    quality_ = 0;
+    return false;
+  }
+  quality_ = quality(sigma_);
+  return true;
+};
+
+
+
+// With F = [I dt*I; 0 d*I] and the covariance in 3x3 blocks [A B; B' C],
+// F P F' = [A + dt (B + B') + dt^2 C, d (B + dt C); ., d^2 C]. The system noise scales with dt^2
+// as in TrackerKalman.
+void TrackerKalmanFixed::predict(double mu[6], double sigma[6][6], const double sys_var[6], double dt)
+{
+  const double dt2 = dt * dt;
+  const double d = DAMPING_VELOCITY;
+
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    mu[i] += dt * mu[i + 3];
+    mu[i + 3] *= d;
+  }
+
+  double a[3][3], b[3][3], c[3][3];
+  for (unsigned int i = 0; i < 3; i++)
+    for (unsigned int j = 0; j < 3; j++)
+    {
+      a[i][j] = sigma[i][j] + dt * (sigma[i][j + 3] + sigma[j][i + 3]) + dt2 * sigma[i + 3][j + 3];
+      b[i][j] = d * (sigma[i][j + 3] + dt * sigma[i + 3][j + 3]);
+      c[i][j] = d * d * sigma[i + 3][j + 3];
+    }
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    a[i][i] += sys_var[i] * dt2;
+    c[i][i] += sys_var[i + 3] * dt2;
+  }
+
+  for (unsigned int i = 0; i < 3; i++)
+    for (unsigned int j = 0; j < 3; j++)
+    {
+      sigma[i][j] = a[i][j];
+      sigma[i][j + 3] = b[i][j];
+      sigma[j + 3][i] = b[i][j];
+      sigma[i + 3][j + 3] = c[i][j];
+    }
+}
+
+
+
+// With H = [I 0], the innovation covariance S is the position block plus the measurement
+// covariance, and the gain K = P H' S^-1 uses the first three columns of P.
+bool TrackerKalmanFixed::correct(double mu[6], double sigma[6][6], const double meas[3], const double cov[3][3])
+{
+  double s[3][3];
+  for (unsigned int i = 0; i < 3; i++)
+    for (unsigned int j = 0; j < 3; j++)
+      s[i][j] = sigma[i][j] + cov[i][j];
+
+  // inverse of S by cofactors
+  double inv[3][3];
+  inv[0][0] = s[1][1] * s[2][2] - s[1][2] * s[2][1];
+  inv[0][1] = s[0][2] * s[2][1] - s[0][1] * s[2][2];
+  inv[0][2] = s[0][1] * s[1][2] - s[0][2] * s[1][1];
+  inv[1][0] = s[1][2] * s[2][0] - s[1][0] * s[2][2];
+  inv[1][1] = s[0][0] * s[2][2] - s[0][2] * s[2][0];
+  inv[1][2] = s[0][2] * s[1][0] - s[0][0] * s[1][2];
+  inv[2][0] = s[1][0] * s[2][1] - s[1][1] * s[2][0];
+  inv[2][1] = s[0][1] * s[2][0] - s[0][0] * s[2][1];
+  inv[2][2] = s[0][0] * s[1][1] - s[0][1] * s[1][0];
+  const double det = s[0][0] * inv[0][0] + s[0][1] * inv[1][0] + s[0][2] * inv[2][0];
+  if (!(det > 0))
+    return false;
+  for (unsigned int i = 0; i < 3; i++)
+    for (unsigned int j = 0; j < 3; j++)
+      inv[i][j] /= det;
+
+  double gain[6][3];
+  for (unsigned int k = 0; k < 6; k++)
+    for (unsigned int j = 0; j < 3; j++)
+      gain[k][j] = sigma[k][0] * inv[0][j] + sigma[k][1] * inv[1][j] + sigma[k][2] * inv[2][j];
+
+  double innovation[3];
+  for (unsigned int i = 0; i < 3; i++)
+    innovation[i] = meas[i] - mu[i];
+  for (unsigned int k = 0; k < 6; k++)
+    mu[k] += gain[k][0] * innovation[0] + gain[k][1] * innovation[1] + gain[k][2] * innovation[2];
+
+  // P - K H P, where H P are the first three rows of P
+  double updated[6][6];
+  for (unsigned int k = 0; k < 6; k++)
+    for (unsigned int l = 0; l <= k; l++)
+      updated[k][l] = sigma[k][l]
+                      - (gain[k][0] * sigma[0][l] + gain[k][1] * sigma[1][l] + gain[k][2] * sigma[2][l]);
+  for (unsigned int k = 0; k < 6; k++)
+    for (unsigned int l = 0; l <= k; l++)
+    {
+      sigma[k][l] = updated[k][l];
+      sigma[l][k] = updated[k][l];
+    }
+  return true;
+}
+
+
+void TrackerKalmanFixed::getEstimate(StatePosVel& est) const
+{
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    est.pos_[i] = mu_[i];
+    est.vel_[i] = mu_[i + 3];
+  }
+};
+
+
+void TrackerKalmanFixed::getEstimate(people_msgs::PositionMeasurement& est) const
+{
+  est.pos.x = mu_[0];
+  est.pos.y = mu_[1];
+  est.pos.z = mu_[2];
+
+  est.header.stamp.fromSec(filter_time_);
+  est.object_id = getName();
+}
+
+
+
+
+double TrackerKalmanFixed::quality(const double sigma[6][6])
+{
+  double sigma_max = max(sqrt(sigma[0][0]), sqrt(sigma[1][1]));
+  return 1.0 - min(1.0, sigma_max / 1.5);
+}
+
+
+double TrackerKalmanFixed::getLifetime() const
+{
+  if (tracker_initialized_)
+    return filter_time_ - init_time_;
+  else
+    return 0;
+}
+
+double TrackerKalmanFixed::getTime() const
+{
+  if (tracker_initialized_)
+    return filter_time_;
+  else
+    return 0;
+}
+
+}; // namespace
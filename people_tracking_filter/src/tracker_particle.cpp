@@ -55,9 +55,12 @@ TrackerParticle::TrackerParticle(const string& name, unsigned int num_particles,
   filter_(NULL),
   sys_model_(sysnoise),
   meas_model_(tf::Vector3(0.1, 0.1, 0.1)),
+  rng_(FastRng::seedFrom(name)),
   tracker_initialized_(false),
   num_particles_(num_particles)
-{};
+{
+  sys_model_.SetRng(&rng_);
+};
 
 
 
@@ -76,10 +79,14 @@ void TrackerParticle::initialize(const StatePosVel& mu, const StatePosVel& sigma
 
 
   GaussianPosVel gauss_pos_vel(mu, sigma);
+  gauss_pos_vel.SetRng(&rng_);
   vector<Sample<StatePosVel> > prior_samples(num_particles_);
   gauss_pos_vel.SampleFrom(prior_samples, num_particles_, CHOLESKY, NULL);
   prior_.ListOfSamplesSet(prior_samples);
-  filter_ = new BootstrapFilter<StatePosVel, tf::Vector3>(&prior_, &prior_, 0, num_particles_ / 4.0);
+  // BFL only weights the particles, they are resampled in place after each correction. BFL asserts
+  // that period and threshold are not both 0, and resamples below an effective sample size of 1.0,
+  // which never happens.
+  filter_ = new BootstrapFilter<StatePosVel, tf::Vector3>(&prior_, &prior_, 0, 1.0);
 
   // tracker initialized
   tracker_initialized_ = true;
@@ -121,6 +128,7 @@ bool TrackerParticle::updateCorrection(const tf::Vector3&  meas, const MatrixWra
   // update filter
   bool res = filter_->Update(&meas_model_, meas);
   if (!res) quality_ = 0;
+  else ((MCPdfPosVel*)(filter_->PostGet()))->resample(resampler_, rng_);
 
   return res;
 };
@@ -140,6 +148,28 @@ void TrackerParticle::getEstimate(StatePosVel& est) const
 };
 
 
+void TrackerParticle::getSpread(StatePosVel& sigma) const
+{
+  const MCPdfPosVel* post = (MCPdfPosVel*)(filter_->PostGet());
+  StatePosVel mean = post->ExpectedValueGet();
+  double pos[3] = {0, 0, 0}, vel[3] = {0, 0, 0};
+  for (unsigned int i = 0; i < post->numParticlesGet(); i++)
+  {
+    WeightedSample<StatePosVel> sample = post->SampleGet(i);
+    for (unsigned int d = 0; d < 3; d++)
+    {
+      pos[d] += sample.WeightGet() * pow(sample.ValueGet().pos_[d] - mean.pos_[d], 2);
+      vel[d] += sample.WeightGet() * pow(sample.ValueGet().vel_[d] - mean.vel_[d], 2);
+    }
+  }
+  for (unsigned int d = 0; d < 3; d++)
+  {
+    sigma.pos_[d] = sqrt(pos[d]);
+    sigma.vel_[d] = sqrt(vel[d]);
+  }
+};
+
+
 void TrackerParticle::getEstimate(people_msgs::PositionMeasurement& est) const
 {
   StatePosVel tmp = filter_->PostGet()->ExpectedValueGet();
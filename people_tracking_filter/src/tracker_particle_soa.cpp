@@ -0,0 +1,467 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "people_tracking_filter/tracker_particle_soa.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace MatrixWrapper;
+using namespace BFL;
+using namespace tf;
+using namespace std;
+
+
+// Below this log likelihood of the best particle, BFL's double precision weights underflow and
+// its filter update fails, and so does this one.
+static const float MIN_LOG_LIKELIHOOD = -745.0f;
+
+// Smallest argument of TrackerParticleSoA::expNonPositive(), whose result is still a normal float
+static const float MIN_EXP_ARG = -87.0f;
+
+// Sums with four independent partial sums, which vectorize without reassociating a single one.
+static double sum(const float* __restrict__ x, unsigned int n)
+{
+  double s[4] = {0, 0, 0, 0};
+  unsigned int i = 0;
+  for (; i + 4 <= n; i += 4)
+    for (unsigned int k = 0; k < 4; k++)
+      s[k] += x[i + k];
+  for (; i < n; i++)
+    s[0] += x[i];
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+static double dot(const float* __restrict__ x, const float* __restrict__ y, unsigned int n)
+{
+  double s[4] = {0, 0, 0, 0};
+  unsigned int i = 0;
+  for (; i + 4 <= n; i += 4)
+    for (unsigned int k = 0; k < 4; k++)
+      s[k] += x[i + k] * y[i + k];
+  for (; i < n; i++)
+    s[0] += x[i] * y[i];
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+static float maximum(const float* __restrict__ x, unsigned int n)
+{
+  float m[4] = {x[0], x[0], x[0], x[0]};
+  unsigned int i = 0;
+  for (; i + 4 <= n; i += 4)
+    for (unsigned int k = 0; k < 4; k++)
+      m[k] = std::max(m[k], x[i + k]);
+  for (; i < n; i++)
+    m[0] = std::max(m[0], x[i]);
+  return std::max(std::max(m[0], m[1]), std::max(m[2], m[3]));
+}
+
+
+namespace estimation
+{
+void TrackerParticleSoA::Particles::resize(unsigned int n)
+{
+  for (unsigned int d = 0; d < 3; d++)
+  {
+    pos[d].resize(n);
+    vel[d].resize(n);
+  }
+}
+
+void TrackerParticleSoA::Particles::swap(Particles& other)
+{
+  for (unsigned int d = 0; d < 3; d++)
+  {
+    pos[d].swap(other.pos[d]);
+    vel[d].swap(other.vel[d]);
+  }
+}
+
+
+// constructor
+TrackerParticleSoA::TrackerParticleSoA(const string& name, unsigned int num_particles, const StatePosVel& sysnoise):
+  Tracker(name),
+  sys_sigma_(sysnoise),
+  meas_sigma_(0.1, 0.1, 0.1),
+  rng_(FastRng::seedFrom(name)),
+  tracker_initialized_(false),
+  init_time_(0),
+  filter_time_(0),
+  quality_(0),
+  resample_fraction_(0.25),
+  num_particles_(std::max(num_particles, 1u)),
+  adaptive_(false),
+  min_particles_(0),
+  max_particles_(0),
+  kld_error_(0),
+  kld_z_(0),
+  bin_pos_(0),
+  bin_vel_(0),
+  bin_generation_(0)
+{
+  allocate(num_particles_);
+};
+
+
+
+// destructor
+TrackerParticleSoA::~TrackerParticleSoA()
+{};
+
+
+
+// all buffers hold max_particles, so that adapting the number of particles does not allocate
+void TrackerParticleSoA::allocate(unsigned int max_particles)
+{
+  particles_.resize(max_particles);
+  resampled_.resize(max_particles);
+  weights_.resize(max_particles);
+  loglik_.resize(max_particles);
+  noise_.resize(6 * max_particles);
+}
+
+
+
+void TrackerParticleSoA::setAdaptive(unsigned int min_particles, unsigned int max_particles, double kld_error,
+                                     double kld_z, double bin_pos, double bin_vel)
+{
+  adaptive_ = true;
+  max_particles_ = std::max(max_particles, 1u);
+  min_particles_ = std::min(std::max(min_particles, 1u), max_particles_);
+  kld_error_ = kld_error;
+  kld_z_ = kld_z;
+  bin_pos_ = bin_pos;
+  bin_vel_ = bin_vel;
+
+  allocate(max_particles_);
+  cumulative_.resize(max_particles_);
+  // at most half full
+  unsigned int bins = 1;
+  while (bins < 2 * max_particles_)
+    bins *= 2;
+  bin_keys_.resize(bins);
+  bin_generations_.assign(bins, 0);
+  bin_generation_ = 0;
+
+  if (!tracker_initialized_)
+    num_particles_ = max_particles_;
+}
+
+
+
+// initialize prior density of filter
+void TrackerParticleSoA::initialize(const StatePosVel& mu, const StatePosVel& sigma, const double time)
+{
+  // the prior is broad, adaptive trackers start with all particles they may use
+  if (adaptive_)
+    num_particles_ = max_particles_;
+
+  const unsigned int n = num_particles_;
+  rng_.fillNormal(&noise_[0], 6 * n);
+  for (unsigned int d = 0; d < 3; d++)
+  {
+    float* __restrict__ pos = &particles_.pos[d][0];
+    float* __restrict__ vel = &particles_.vel[d][0];
+    const float* __restrict__ noise_pos = &noise_[d * n];
+    const float* __restrict__ noise_vel = &noise_[(3 + d) * n];
+    const float mu_pos = mu.pos_[d], mu_vel = mu.vel_[d];
+    const float sigma_pos = sigma.pos_[d], sigma_vel = sigma.vel_[d];
+    for (unsigned int i = 0; i < n; i++)
+    {
+      pos[i] = mu_pos + sigma_pos * noise_pos[i];
+      vel[i] = mu_vel + sigma_vel * noise_vel[i];
+    }
+  }
+  std::fill(weights_.begin(), weights_.begin() + n, 1.0f / n);
+
+  // tracker initialized
+  tracker_initialized_ = true;
+  quality_ = 1;
+  filter_time_ = time;
+  init_time_ = time;
+}
+
+
+
+// update filter prediction: constant velocity, with noise that scales with dt as in SysPdfPosVel
+bool TrackerParticleSoA::updatePrediction(const double time)
+{
+  if (time > filter_time_)
+  {
+    const unsigned int n = num_particles_;
+    const float dt = time - filter_time_;
+    filter_time_ = time;
+
+    rng_.fillNormal(&noise_[0], 6 * n);
+    for (unsigned int d = 0; d < 3; d++)
+    {
+      float* __restrict__ pos = &particles_.pos[d][0];
+      float* __restrict__ vel = &particles_.vel[d][0];
+      const float* __restrict__ noise_pos = &noise_[d * n];
+      const float* __restrict__ noise_vel = &noise_[(3 + d) * n];
+      const float sigma_pos = sys_sigma_.pos_[d] * dt, sigma_vel = sys_sigma_.vel_[d] * dt;
+      for (unsigned int i = 0; i < n; i++)
+      {
+        pos[i] += vel[i] * dt + sigma_pos * noise_pos[i];
+        vel[i] += sigma_vel * noise_vel[i];
+      }
+    }
+  }
+  return true;
+};
+
+
+
+// update filter correction: weight by the Gaussian position likelihood of MeasPdfPos
+bool TrackerParticleSoA::updateCorrection(const tf::Vector3&  meas, const MatrixWrapper::SymmetricMatrix& cov)
+{
+  assert(cov.columns() == 3);
+  meas_sigma_ = tf::Vector3(sqrt(cov(1, 1)), sqrt(cov(2, 2)), sqrt(cov(3, 3)));
+
+  const unsigned int n = num_particles_;
+  float* __restrict__ loglik = &loglik_[0];
+  float* __restrict__ weights = &weights_[0];
+
+  // log likelihood up to a constant, which normalization removes
+  std::fill(loglik_.begin(), loglik_.end(), 0.0f);
+  for (unsigned int d = 0; d < 3; d++)
+  {
+    const float* __restrict__ pos = &particles_.pos[d][0];
+    const float m = meas[d];
+    const float scale = -1.0f / (2 * meas_sigma_[d] * meas_sigma_[d]);
+    for (unsigned int i = 0; i < n; i++)
+    {
+      float diff = pos[i] - m;
+      loglik[i] += scale * diff * diff;
+    }
+  }
+
+  // relative to the best particle, so that the weights do not underflow
+  const float best = maximum(loglik, n);
+  if (!(best > MIN_LOG_LIKELIHOOD))
+  {
+    quality_ = 0;
+    return false;
+  }
+  // clamped in a loop of its own, GCC does not vectorize the clamp and the exponential together
+  for (unsigned int i = 0; i < n; i++)
+    loglik[i] = std::max(loglik[i] - best, MIN_EXP_ARG);
+  for (unsigned int i = 0; i < n; i++)
+    weights[i] *= expNonPositive(loglik[i]);
+
+  const double total = sum(weights, n);
+  if (!(total > 0))
+  {
+    quality_ = 0;
+    return false;
+  }
+  const float normalize = 1.0 / total;
+  for (unsigned int i = 0; i < n; i++)
+    weights[i] *= normalize;
+
+  // KLD-sampling adapts the number of particles on every correction
+  if (adaptive_)
+    resampleKld();
+  else if (1.0 / dot(weights, weights, n) < resample_fraction_ * n)
+    resample();
+
+  return true;
+};
+
+
+
+// systematic resampling into the second particle buffer
+void TrackerParticleSoA::resample()
+{
+  const unsigned int n = num_particles_;
+  double target = rng_.uniform() / n, cumulative = weights_[0];
+  unsigned int j = 0;
+  for (unsigned int i = 0; i < n; i++, target += 1.0 / n)
+  {
+    while (target > cumulative && j + 1 < n)
+      cumulative += weights_[++j];
+    for (unsigned int d = 0; d < 3; d++)
+    {
+      resampled_.pos[d][i] = particles_.pos[d][j];
+      resampled_.vel[d][i] = particles_.vel[d][j];
+    }
+  }
+  particles_.swap(resampled_);
+  std::fill(weights_.begin(), weights_.begin() + n, 1.0f / n);
+}
+
+
+
+// Draw particles in proportion to their weights until the number of occupied bins k asks for no
+// more, (k - 1) / (2 kld_error) (1 - 2 / (9 (k - 1)) + sqrt(2 / (9 (k - 1))) kld_z)^3 by the
+// Wilson-Hilferty approximation of the chi-square quantile [Fox, 2003].
+void TrackerParticleSoA::resampleKld()
+{
+  const unsigned int n = num_particles_;
+  float* cumulative = &cumulative_[0];
+  double total = 0;
+  for (unsigned int i = 0; i < n; i++)
+  {
+    total += weights_[i];
+    cumulative[i] = total;
+  }
+
+  if (++bin_generation_ == 0)
+  {
+    std::fill(bin_generations_.begin(), bin_generations_.end(), 0);
+    bin_generation_ = 1;
+  }
+
+  unsigned int m = 0, bins = 0, needed = min_particles_;
+  while (m < max_particles_ && m < needed)
+  {
+    unsigned int j = std::upper_bound(cumulative, cumulative + n, rng_.uniform() * total) - cumulative;
+    j = std::min(j, n - 1);
+    for (unsigned int d = 0; d < 3; d++)
+    {
+      resampled_.pos[d][m] = particles_.pos[d][j];
+      resampled_.vel[d][m] = particles_.vel[d][j];
+    }
+    if (insertBin(j))
+      needed = std::max(min_particles_, kldParticles(++bins));
+    m++;
+  }
+
+  particles_.swap(resampled_);
+  num_particles_ = m;
+  std::fill(weights_.begin(), weights_.begin() + m, 1.0f / m);
+}
+
+
+
+// Mark the bin of a particle occupied, returns true if it was empty. People move on the ground
+// plane, so the bins cover position and velocity in x and y.
+bool TrackerParticleSoA::insertBin(unsigned int particle)
+{
+  uint64_t key = 0xcbf29ce484222325ULL;
+  for (unsigned int d = 0; d < 2; d++)
+  {
+    key = (key ^ (uint32_t)(int32_t)floor(particles_.pos[d][particle] / bin_pos_)) * 0x100000001b3ULL;
+    key = (key ^ (uint32_t)(int32_t)floor(particles_.vel[d][particle] / bin_vel_)) * 0x100000001b3ULL;
+  }
+
+  const unsigned int mask = bin_keys_.size() - 1;
+  unsigned int b = (key ^ (key >> 32)) & mask;
+  while (bin_generations_[b] == bin_generation_)
+  {
+    if (bin_keys_[b] == key)
+      return false;
+    b = (b + 1) & mask;
+  }
+  bin_generations_[b] = bin_generation_;
+  bin_keys_[b] = key;
+  return true;
+}
+
+
+
+unsigned int TrackerParticleSoA::kldParticles(unsigned int bins) const
+{
+  if (bins < 2)
+    return 0;
+  double a = 2.0 / (9.0 * (bins - 1));
+  double b = 1 - a + sqrt(a) * kld_z_;
+  return (unsigned int)ceil((bins - 1) / (2 * kld_error_) * b * b * b);
+}
+
+
+
+// get most recent filter posterior
+void TrackerParticleSoA::getEstimate(StatePosVel& est) const
+{
+  const unsigned int n = num_particles_;
+  const float* weights = &weights_[0];
+  for (unsigned int d = 0; d < 3; d++)
+  {
+    est.pos_[d] = dot(&particles_.pos[d][0], weights, n);
+    est.vel_[d] = dot(&particles_.vel[d][0], weights, n);
+  }
+};
+
+
+void TrackerParticleSoA::getSpread(StatePosVel& sigma) const
+{
+  const unsigned int n = num_particles_;
+  StatePosVel mean;
+  getEstimate(mean);
+  for (unsigned int d = 0; d < 3; d++)
+  {
+    double pos = 0, vel = 0;
+    for (unsigned int i = 0; i < n; i++)
+    {
+      pos += weights_[i] * pow(particles_.pos[d][i] - mean.pos_[d], 2);
+      vel += weights_[i] * pow(particles_.vel[d][i] - mean.vel_[d], 2);
+    }
+    sigma.pos_[d] = sqrt(pos);
+    sigma.vel_[d] = sqrt(vel);
+  }
+};
+
+
+void TrackerParticleSoA::getEstimate(people_msgs::PositionMeasurement& est) const
+{
+  StatePosVel tmp;
+  getEstimate(tmp);
+
+  est.pos.x = tmp.pos_[0];
+  est.pos.y = tmp.pos_[1];
+  est.pos.z = tmp.pos_[2];
+
+  est.header.stamp.fromSec(filter_time_);
+  est.object_id = getName();
+}
+
+
+double TrackerParticleSoA::getLifetime() const
+{
+  if (tracker_initialized_)
+    return filter_time_ - init_time_;
+  else
+    return 0;
+}
+
+
+double TrackerParticleSoA::getTime() const
+{
+  if (tracker_initialized_)
+    return filter_time_;
+  else
+    return 0;
+}
+}; // namespace
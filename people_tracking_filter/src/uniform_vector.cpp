@@ -35,7 +35,6 @@
 /* Author: Wim Meeussen */
 
 #include "people_tracking_filter/uniform_vector.h"
-#include <wrappers/rng/rng.h>
 #include <cmath>
 #include <cassert>
 
@@ -46,7 +45,8 @@ namespace BFL
 UniformVector::UniformVector(const Vector3& mu, const Vector3& size)
   : Pdf<Vector3> (1),
     mu_(mu),
-    size_(size)
+    size_(size),
+    rng_(NULL)
 {
   for (unsigned int i = 0; i < 3; i++)
     assert(size_[i] > 0);
@@ -85,10 +85,15 @@ Probability UniformVector::ProbabilityGet(const Vector3& input) const
 bool
 UniformVector::SampleFrom(vector<Sample<Vector3> >& list_samples, const int num_samples, int method, void * args) const
 {
+  // all variates at once, the generator fills whole blocks faster than single draws
   list_samples.resize(num_samples);
-  vector<Sample<Vector3> >::iterator sample_it = list_samples.begin();
-  for (sample_it = list_samples.begin(); sample_it != list_samples.end(); sample_it++)
-    SampleFrom(*sample_it, method, args);
+  vector<float> unit(3 * num_samples);
+  if (num_samples > 0)
+    (rng_ ? *rng_ : FastRng::threadDefault()).fillUniform(&unit[0], unit.size());
+  for (int i = 0; i < num_samples; i++)
+    list_samples[i].ValueSet(Vector3(((unit[3 * i] - 0.5) * 2 * size_[0]) + mu_[0],
+                                     ((unit[3 * i + 1] - 0.5) * 2 * size_[1]) + mu_[1],
+                                     ((unit[3 * i + 2] - 0.5) * 2 * size_[2]) + mu_[2]));
 
   return true;
 }
@@ -97,9 +102,10 @@ UniformVector::SampleFrom(vector<Sample<Vector3> >& list_samples, const int num_
 bool
 UniformVector::SampleFrom(Sample<Vector3>& one_sample, int method, void * args) const
 {
-  one_sample.ValueSet(Vector3(((runif() - 0.5) * 2 * size_[0]) + mu_[0],
-                              ((runif() - 0.5) * 2 * size_[1]) + mu_[1],
-                              ((runif() - 0.5) * 2 * size_[2]) + mu_[2]));
+  FastRng& rng = rng_ ? *rng_ : FastRng::threadDefault();
+  one_sample.ValueSet(Vector3(((rng.uniform() - 0.5) * 2 * size_[0]) + mu_[0],
+                              ((rng.uniform() - 0.5) * 2 * size_[1]) + mu_[1],
+                              ((rng.uniform() - 0.5) * 2 * size_[2]) + mu_[2]));
   return true;
 }
 
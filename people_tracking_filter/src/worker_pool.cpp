@@ -0,0 +1,188 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "people_tracking_filter/worker_pool.h"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+
+using namespace std;
+
+
+namespace estimation
+{
+// constructor
+WorkerPool::WorkerPool(unsigned int threads):
+  threads_(max(threads, 1u)),
+  share_mutex_(new boost::mutex[threads_]),
+  begin_(new unsigned int[threads_]),
+  end_(new unsigned int[threads_]),
+  job_(NULL),
+  generation_(0),
+  running_(0)
+{
+  for (unsigned int t = 0; t < threads_; t++)
+    begin_[t] = end_[t] = 0;
+
+  // the thread that calls run() does the share of thread 0
+  for (unsigned int t = 1; t < threads_; t++)
+    workers_.create_thread(boost::bind(&WorkerPool::workerLoop, this, t));
+}
+
+
+
+// destructor
+WorkerPool::~WorkerPool()
+{
+  workers_.interrupt_all();
+  workers_.join_all();
+}
+
+
+
+void WorkerPool::run(unsigned int count, const Job& job)
+{
+  if (count == 0)
+    return;
+
+  {
+    boost::mutex::scoped_lock lock(run_mutex_);
+    for (unsigned int t = 0; t < threads_; t++)
+    {
+      boost::mutex::scoped_lock share_lock(share_mutex_[t]);
+      begin_[t] = (unsigned long)count * t / threads_;
+      end_[t] = (unsigned long)count * (t + 1) / threads_;
+    }
+    job_ = &job;
+    running_ = threads_ - 1;
+    generation_++;
+  }
+  start_cond_.notify_all();
+
+  work(0);
+
+  boost::mutex::scoped_lock lock(run_mutex_);
+  while (running_ > 0)
+    done_cond_.wait(lock);
+  job_ = NULL;
+}
+
+
+
+void WorkerPool::workerLoop(unsigned int thread)
+{
+  try
+  {
+    unsigned long generation = 0;
+    for (;;)
+    {
+      {
+        boost::mutex::scoped_lock lock(run_mutex_);
+        while (generation_ == generation)
+          start_cond_.wait(lock);
+        generation = generation_;
+      }
+
+      work(thread);
+
+      boost::mutex::scoped_lock lock(run_mutex_);
+      if (--running_ == 0)
+        done_cond_.notify_all();
+    }
+  }
+  catch (boost::thread_interrupted&)
+  {
+  }
+}
+
+
+
+void WorkerPool::work(unsigned int thread)
+{
+  unsigned int index;
+  while (take(thread, index))
+    (*job_)(index);
+}
+
+
+
+// Take the next index of the own share, or steal the back half of the largest other share
+bool WorkerPool::take(unsigned int thread, unsigned int& index)
+{
+  {
+    boost::mutex::scoped_lock lock(share_mutex_[thread]);
+    if (begin_[thread] < end_[thread])
+    {
+      index = begin_[thread]++;
+      return true;
+    }
+  }
+
+  for (;;)
+  {
+    unsigned int victim = thread, largest = 0;
+    for (unsigned int t = 0; t < threads_; t++)
+    {
+      boost::mutex::scoped_lock lock(share_mutex_[t]);
+      if (end_[t] - begin_[t] > largest)
+      {
+        largest = end_[t] - begin_[t];
+        victim = t;
+      }
+    }
+    if (largest == 0)
+      return false;
+
+    unsigned int begin, end;
+    {
+      boost::mutex::scoped_lock lock(share_mutex_[victim]);
+      // the share may have shrunk since, then look again
+      if (begin_[victim] == end_[victim])
+        continue;
+      end = end_[victim];
+      begin = begin_[victim] + (end - begin_[victim]) / 2;
+      end_[victim] = begin;
+    }
+
+    // nobody steals from an empty share, so the own one is still empty here
+    boost::mutex::scoped_lock lock(share_mutex_[thread]);
+    index = begin;
+    begin_[thread] = begin + 1;
+    end_[thread] = end;
+    return true;
+  }
+}
+
+}; // namespace
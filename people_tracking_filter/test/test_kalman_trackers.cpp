@@ -0,0 +1,162 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+// TrackerKalmanFixed and the trackers of a TrackerBank are to give the estimates and quality of
+// TrackerKalman, the BFL filter they replace.
+
+#include <people_tracking_filter/tracker_kalman.h>
+#include <people_tracking_filter/tracker_kalman_fixed.h>
+#include <people_tracking_filter/tracker_bank.h>
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdlib>
+
+using namespace estimation;
+using namespace BFL;
+
+static const double TOLERANCE = 1e-9;
+
+// the system noise of launch/filter.launch
+static const StatePosVel SYS_SIGMA(tf::Vector3(0.8, 0.8, 0.3), tf::Vector3(0.5, 0.5, 0.5));
+
+static void expectSame(const Tracker& expected, const Tracker& actual, int step)
+{
+  StatePosVel e, a;
+  expected.getEstimate(e);
+  actual.getEstimate(a);
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    EXPECT_NEAR(e.pos_[i], a.pos_[i], TOLERANCE) << "position " << i << " at step " << step;
+    EXPECT_NEAR(e.vel_[i], a.vel_[i], TOLERANCE) << "velocity " << i << " at step " << step;
+  }
+  EXPECT_NEAR(expected.getQuality(), actual.getQuality(), TOLERANCE) << "quality at step " << step;
+  EXPECT_NEAR(expected.getTime(), actual.getTime(), TOLERANCE) << "time at step " << step;
+  EXPECT_NEAR(expected.getLifetime(), actual.getLifetime(), TOLERANCE) << "lifetime at step " << step;
+}
+
+TEST(KalmanTrackers, sameEstimatesAndQuality)
+{
+  TrackerKalman kalman("kalman", SYS_SIGMA);
+  TrackerKalmanFixed fixed("fixed", SYS_SIGMA);
+  TrackerBank bank(SYS_SIGMA);
+  TrackerBankView* view = bank.createTracker("bank");
+
+  StatePosVel mu(tf::Vector3(1.0, 2.0, 0.5), tf::Vector3(0.0, 0.0, 0.0));
+  StatePosVel sigma(tf::Vector3(0.1, 0.2, 0.3), tf::Vector3(1e-7, 1e-7, 1e-7));
+  kalman.initialize(mu, sigma, 0.0);
+  fixed.initialize(mu, sigma, 0.0);
+  view->initialize(mu, sigma, 0.0);
+  expectSame(kalman, fixed, 0);
+  expectSame(kalman, *view, 0);
+
+  // a correlated measurement covariance
+  MatrixWrapper::SymmetricMatrix cov(3);
+  cov = 0.0;
+  cov(1, 1) = 0.01;
+  cov(1, 2) = 0.002;
+  cov(2, 2) = 0.02;
+  cov(2, 3) = 0.001;
+  cov(3, 3) = 0.03;
+
+  // a person walking along x at 0.7 m/s and along y at -0.3 m/s, measured at uneven times, with
+  // some predictions without a measurement
+  srand(1);
+  double time = 0.0;
+  for (int step = 1; step <= 200; step++)
+  {
+    time += 0.05 + 0.1 * rand() / (double)RAND_MAX;
+    kalman.updatePrediction(time);
+    fixed.updatePrediction(time);
+    // the bank predicts all of its trackers at once, or one of them
+    if (step % 2 == 0)
+      bank.updatePrediction(time);
+    else
+      view->updatePrediction(time);
+
+    if (step % 3 != 0)
+    {
+      tf::Vector3 meas(1.0 + 0.7 * time + 0.05 * sin(step), 2.0 - 0.3 * time, 0.5 + 0.01 * cos(step));
+      EXPECT_TRUE(kalman.updateCorrection(meas, cov));
+      EXPECT_TRUE(fixed.updateCorrection(meas, cov));
+      EXPECT_TRUE(view->updateCorrection(meas, cov));
+    }
+
+    expectSame(kalman, fixed, step);
+    expectSame(kalman, *view, step);
+  }
+
+  delete view;
+}
+
+// Trackers of a bank stay independent when others are created and deleted between them
+TEST(KalmanTrackers, bankReusesSlots)
+{
+  TrackerBank bank(SYS_SIGMA);
+  StatePosVel sigma(tf::Vector3(0.1, 0.1, 0.1), tf::Vector3(1e-7, 1e-7, 1e-7));
+
+  TrackerBankView* first = bank.createTracker("first");
+  TrackerBankView* second = bank.createTracker("second");
+  first->initialize(StatePosVel(tf::Vector3(1, 0, 0), tf::Vector3(0, 0, 0)), sigma, 0.0);
+  second->initialize(StatePosVel(tf::Vector3(5, 0, 0), tf::Vector3(0, 0, 0)), sigma, 0.0);
+  EXPECT_EQ(2u, bank.size());
+
+  delete first;
+  EXPECT_EQ(1u, bank.size());
+  TrackerBankView* third = bank.createTracker("third");
+  EXPECT_FALSE(third->isInitialized());
+  third->initialize(StatePosVel(tf::Vector3(9, 0, 0), tf::Vector3(0, 0, 0)), sigma, 0.5);
+
+  TrackerKalmanFixed expected("expected", SYS_SIGMA);
+  expected.initialize(StatePosVel(tf::Vector3(5, 0, 0), tf::Vector3(0, 0, 0)), sigma, 0.0);
+  bank.updatePrediction(1.0);
+  expected.updatePrediction(1.0);
+  expectSame(expected, *second, 1);
+
+  StatePosVel est;
+  third->getEstimate(est);
+  EXPECT_NEAR(9.0, est.pos_[0], TOLERANCE);
+  EXPECT_NEAR(0.5, third->getLifetime(), TOLERANCE);
+
+  delete second;
+  delete third;
+  EXPECT_EQ(0u, bank.size());
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
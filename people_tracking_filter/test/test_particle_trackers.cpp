@@ -0,0 +1,325 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+// TrackerParticleSoA is to follow the posterior of TrackerParticle, the BFL filter with the same
+// models. Both are random, so their estimates only agree within a fraction of the posterior spread.
+// With KLD-sampling, it is to keep as many particles as the occupied bins ask for.
+
+#include <people_tracking_filter/tracker_particle.h>
+#include <people_tracking_filter/tracker_particle_soa.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <set>
+#include <vector>
+
+using namespace estimation;
+using namespace BFL;
+
+static const unsigned int NUM_PARTICLES = 5000;
+
+// The estimates may differ by this fraction of the posterior spread, and the spreads by this ratio.
+// Two TrackerParticleSoA with different seeds came within 0.42 and 0.22 over 50 runs of this test.
+static const double MEAN_TOLERANCE = 0.6;
+static const double SPREAD_TOLERANCE = 0.4;
+
+// the system noise of launch/filter.launch
+static const StatePosVel SYS_SIGMA(tf::Vector3(0.8, 0.8, 0.3), tf::Vector3(0.5, 0.5, 0.5));
+
+namespace estimation
+{
+// Gives the tests access to the internals of TrackerParticleSoA
+class TrackerParticleSoATest : public testing::Test
+{
+protected:
+  static float expNonPositive(float x)
+  {
+    return TrackerParticleSoA::expNonPositive(x);
+  }
+
+  static unsigned int kldParticles(const TrackerParticleSoA& tracker, unsigned int bins)
+  {
+    return tracker.kldParticles(bins);
+  }
+
+  // the bins of the particles, counted independently of the bin set of the tracker
+  static unsigned int occupiedBins(const TrackerParticleSoA& tracker)
+  {
+    std::set<std::vector<int> > bins;
+    for (unsigned int i = 0; i < tracker.num_particles_; i++)
+    {
+      std::vector<int> bin(4);
+      for (unsigned int d = 0; d < 2; d++)
+      {
+        bin[2 * d] = (int)floor(tracker.particles_.pos[d][i] / tracker.bin_pos_);
+        bin[2 * d + 1] = (int)floor(tracker.particles_.vel[d][i] / tracker.bin_vel_);
+      }
+      bins.insert(bin);
+    }
+    return bins.size();
+  }
+
+  // the bins the tracker marked occupied in its last resampling
+  static unsigned int markedBins(const TrackerParticleSoA& tracker)
+  {
+    return std::count(tracker.bin_generations_.begin(), tracker.bin_generations_.end(), tracker.bin_generation_);
+  }
+
+  static uint32_t binGeneration(const TrackerParticleSoA& tracker)
+  {
+    return tracker.bin_generation_;
+  }
+
+  // Moves the bin set to the given generation, with every other bin left marked by generation 1
+  static void setBinGeneration(TrackerParticleSoA& tracker, uint32_t generation)
+  {
+    tracker.bin_generation_ = generation;
+    for (unsigned int b = 0; b < tracker.bin_generations_.size(); b += 2)
+      tracker.bin_generations_[b] = 1;
+  }
+
+  // KLD-sampling keeps the particles the bins ask for, within the bounds
+  static void expectKldParticles(const TrackerParticleSoA& tracker, unsigned int min_particles,
+                                 unsigned int max_particles, int step)
+  {
+    unsigned int n = tracker.getNumParticles();
+    EXPECT_GE(n, min_particles) << "at step " << step;
+    EXPECT_LE(n, max_particles) << "at step " << step;
+    unsigned int bins = occupiedBins(tracker);
+    EXPECT_EQ(bins, markedBins(tracker)) << "at step " << step;
+    EXPECT_EQ(std::min(max_particles, std::max(min_particles, kldParticles(tracker, bins))), n)
+        << "with " << bins << " bins at step " << step;
+  }
+};
+};
+
+static void expectSimilar(const TrackerParticle& expected, const TrackerParticleSoA& actual, int step)
+{
+  StatePosVel e, a, e_sigma, a_sigma;
+  expected.getEstimate(e);
+  actual.getEstimate(a);
+  expected.getSpread(e_sigma);
+  actual.getSpread(a_sigma);
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    EXPECT_NEAR(e.pos_[i], a.pos_[i], MEAN_TOLERANCE * e_sigma.pos_[i]) << "position " << i << " at step " << step;
+    EXPECT_NEAR(e.vel_[i], a.vel_[i], MEAN_TOLERANCE * e_sigma.vel_[i]) << "velocity " << i << " at step " << step;
+    EXPECT_NEAR(1.0, a_sigma.pos_[i] / e_sigma.pos_[i], SPREAD_TOLERANCE)
+        << "position spread " << i << " at step " << step;
+    EXPECT_NEAR(1.0, a_sigma.vel_[i] / e_sigma.vel_[i], SPREAD_TOLERANCE)
+        << "velocity spread " << i << " at step " << step;
+  }
+  EXPECT_EQ(expected.getQuality(), actual.getQuality()) << "quality at step " << step;
+  EXPECT_NEAR(expected.getTime(), actual.getTime(), 1e-9) << "time at step " << step;
+}
+
+TEST_F(TrackerParticleSoATest, sameMeanAndSpread)
+{
+  TrackerParticle bfl("bfl", NUM_PARTICLES, SYS_SIGMA);
+  TrackerParticleSoA soa("soa", NUM_PARTICLES, SYS_SIGMA);
+  bfl.seed(1);
+  soa.seed(2);
+
+  StatePosVel mu(tf::Vector3(1.0, 2.0, 0.5), tf::Vector3(0.0, 0.0, 0.0));
+  StatePosVel sigma(tf::Vector3(0.3, 0.3, 0.1), tf::Vector3(0.5, 0.5, 0.1));
+  bfl.initialize(mu, sigma, 0.0);
+  soa.initialize(mu, sigma, 0.0);
+  expectSimilar(bfl, soa, 0);
+
+  MatrixWrapper::SymmetricMatrix cov(3);
+  cov = 0.0;
+  cov(1, 1) = 0.04;
+  cov(2, 2) = 0.04;
+  cov(3, 3) = 0.04;
+
+  // a person walking along x at 0.7 m/s and along y at -0.3 m/s, measured at uneven times, with
+  // some predictions without a measurement
+  srand(1);
+  double time = 0.0;
+  for (int step = 1; step <= 100; step++)
+  {
+    time += 0.05 + 0.1 * rand() / (double)RAND_MAX;
+    EXPECT_TRUE(bfl.updatePrediction(time));
+    EXPECT_TRUE(soa.updatePrediction(time));
+
+    if (step % 3 != 0)
+    {
+      tf::Vector3 meas(1.0 + 0.7 * time + 0.1 * sin(step), 2.0 - 0.3 * time, 0.5 + 0.05 * cos(step));
+      EXPECT_TRUE(bfl.updateCorrection(meas, cov));
+      EXPECT_TRUE(soa.updateCorrection(meas, cov));
+    }
+
+    expectSimilar(bfl, soa, step);
+  }
+}
+
+// The weights of the particles depend on the polynomial exponential
+TEST_F(TrackerParticleSoATest, expNonPositiveAccuracy)
+{
+  double worst = 0.0, worst_x = 0.0;
+  for (int k = 0; k <= 870000; k++)
+  {
+    float x = -k * 1e-4f;
+    double error = fabs(expNonPositive(x) / exp((double)x) - 1.0);
+    if (error > worst)
+    {
+      worst = error;
+      worst_x = x;
+    }
+  }
+  EXPECT_LT(worst, 2e-6) << "at " << worst_x;
+  EXPECT_NEAR(1.0, expNonPositive(0.0f), 2e-6);
+  EXPECT_NEAR(1.0, expNonPositive(-87.0f) / exp(-87.0), 2e-6);
+}
+
+// The number of particles for k bins approximates the chi-square quantile with k - 1 degrees of
+// freedom at 1 - delta, where kld_z is the standard normal quantile at 1 - delta, divided by
+// 2 kld_error [Fox, 2003].
+TEST_F(TrackerParticleSoATest, kldParticlesMatchesWilsonHilferty)
+{
+  const double error = 0.05, z = 2.326;
+  TrackerParticleSoA tracker("kld", 100, SYS_SIGMA);
+  tracker.setAdaptive(100, 5000, error, z);
+
+  // chi-square quantiles at 0.99
+  const unsigned int bins[] = {2, 3, 10, 50, 200};
+  const double chi_square[] = {6.6349, 9.2103, 21.666, 74.9195, 248.3286};
+  for (unsigned int i = 0; i < 5; i++)
+  {
+    unsigned int k = bins[i];
+    double a = 2.0 / (9.0 * (k - 1));
+    double wilson_hilferty = (k - 1) / (2 * error) * pow(1 - a + sqrt(a) * z, 3);
+    EXPECT_EQ((unsigned int)ceil(wilson_hilferty), kldParticles(tracker, k)) << k << " bins";
+    EXPECT_NEAR(chi_square[i] / (2 * error), kldParticles(tracker, k), 0.01 * chi_square[i] / (2 * error) + 1)
+        << k << " bins";
+  }
+  EXPECT_EQ(0u, kldParticles(tracker, 1));
+}
+
+TEST_F(TrackerParticleSoATest, kldParticlesWithinBounds)
+{
+  const unsigned int min_particles = 100, max_particles = 5000;
+  TrackerParticleSoA tracker("kld", 100, SYS_SIGMA);
+  tracker.setAdaptive(min_particles, max_particles);
+  tracker.seed(1);
+
+  StatePosVel mu(tf::Vector3(1.0, 2.0, 0.5), tf::Vector3(0.0, 0.0, 0.0));
+  StatePosVel sigma(tf::Vector3(0.3, 0.3, 0.1), tf::Vector3(0.5, 0.5, 0.1));
+  tracker.initialize(mu, sigma, 0.0);
+  EXPECT_EQ(max_particles, tracker.getNumParticles());
+
+  MatrixWrapper::SymmetricMatrix cov(3);
+  cov = 0.0;
+  cov(1, 1) = 0.04;
+  cov(2, 2) = 0.04;
+  cov(3, 3) = 0.04;
+
+  srand(1);
+  double time = 0.0;
+  for (int step = 1; step <= 100; step++)
+  {
+    time += 0.05 + 0.1 * rand() / (double)RAND_MAX;
+    EXPECT_TRUE(tracker.updatePrediction(time));
+    tf::Vector3 meas(1.0 + 0.7 * time + 0.1 * sin(step), 2.0 - 0.3 * time, 0.5 + 0.05 * cos(step));
+    EXPECT_TRUE(tracker.updateCorrection(meas, cov));
+    expectKldParticles(tracker, min_particles, max_particles, step);
+  }
+}
+
+// A posterior within a few bins needs no more than min_particles, a broad one needs all of them
+TEST_F(TrackerParticleSoATest, kldParticlesFollowSpread)
+{
+  const unsigned int min_particles = 100, max_particles = 5000;
+  MatrixWrapper::SymmetricMatrix cov(3);
+  cov = 0.0;
+
+  // in the middle of a bin of 0.1 m and 0.2 m/s
+  TrackerParticleSoA concentrated("concentrated", 100, SYS_SIGMA);
+  concentrated.setAdaptive(min_particles, max_particles);
+  concentrated.seed(1);
+  StatePosVel mu(tf::Vector3(1.05, 2.05, 0.5), tf::Vector3(0.1, 0.1, 0.0));
+  concentrated.initialize(mu, StatePosVel(tf::Vector3(0.005, 0.005, 0.005), tf::Vector3(0.005, 0.005, 0.005)), 0.0);
+  cov(1, 1) = cov(2, 2) = cov(3, 3) = 1e-4;
+  for (int step = 1; step <= 5; step++)
+  {
+    EXPECT_TRUE(concentrated.updateCorrection(mu.pos_, cov));
+    EXPECT_EQ(min_particles, concentrated.getNumParticles()) << "at step " << step;
+  }
+
+  TrackerParticleSoA broad("broad", 100, SYS_SIGMA);
+  broad.setAdaptive(min_particles, max_particles);
+  broad.seed(1);
+  broad.initialize(mu, StatePosVel(tf::Vector3(5, 5, 5), tf::Vector3(5, 5, 5)), 0.0);
+  cov(1, 1) = cov(2, 2) = cov(3, 3) = 100;
+  for (int step = 1; step <= 5; step++)
+  {
+    EXPECT_TRUE(broad.updateCorrection(mu.pos_, cov));
+    EXPECT_GE(broad.getNumParticles(), 0.9 * max_particles) << "at step " << step;
+  }
+}
+
+// The bin set is cleared by advancing its generation, and fully once the generation wraps around
+TEST_F(TrackerParticleSoATest, binsSurviveGenerationWraparound)
+{
+  const unsigned int min_particles = 100, max_particles = 2000;
+  TrackerParticleSoA tracker("kld", 100, SYS_SIGMA);
+  tracker.setAdaptive(min_particles, max_particles);
+  tracker.seed(1);
+  tracker.initialize(StatePosVel(tf::Vector3(1.0, 2.0, 0.5), tf::Vector3(0.0, 0.0, 0.0)),
+                     StatePosVel(tf::Vector3(0.3, 0.3, 0.1), tf::Vector3(0.5, 0.5, 0.1)), 0.0);
+
+  MatrixWrapper::SymmetricMatrix cov(3);
+  cov = 0.0;
+  cov(1, 1) = cov(2, 2) = cov(3, 3) = 0.04;
+
+  setBinGeneration(tracker, 0xfffffffe);
+  double time = 0.0;
+  for (int step = 1; step <= 3; step++)
+  {
+    time += 0.1;
+    EXPECT_TRUE(tracker.updatePrediction(time));
+    EXPECT_TRUE(tracker.updateCorrection(tf::Vector3(1.0 + 0.7 * time, 2.0, 0.5), cov));
+    expectKldParticles(tracker, min_particles, max_particles, step);
+  }
+  EXPECT_EQ(2u, binGeneration(tracker));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}